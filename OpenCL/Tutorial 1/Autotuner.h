@@ -0,0 +1,165 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Utils.h"
+#include "TuningProfile.h"
+#include "WeatherStatsEngine.h"
+
+//Grid-stride kernels the autotuner sweeps, with the number of values each work-item loads per step
+struct TunedKernel {
+    const char* name;
+    size_t vector_width;
+};
+
+const TunedKernel TUNED_KERNELS[] = {
+    { "min_reduce_vec", 4 },
+    { "max_reduce_vec", 4 },
+    { "reduce_vec", 4 },
+    { "moments_fused", 1 }
+};
+
+std::string deviceName(const cl::Context& context) {
+    return context.getInfo<CL_CONTEXT_DEVICES>()[0].getInfo<CL_DEVICE_NAME>();
+}
+
+std::string driverVersion(const cl::Context& context) {
+    return context.getInfo<CL_CONTEXT_DEVICES>()[0].getInfo<CL_DRIVER_VERSION>();
+}
+
+//Give an engine the settings from a profile. The work-group size can't be changed after the engine is built,
+//...so construct the engine with profile.workgroup_size first
+void applyTuningProfile(WeatherStatsEngine& engine, const TuningProfile& profile) {
+    for (const auto& kernel : profile.kernels)
+        engine.setGroupsPerComputeUnit(kernel.first, kernel.second.groups_per_compute_unit);
+    if (profile.host_finish_threshold)
+        engine.setHostFinishThreshold(profile.host_finish_threshold);
+}
+
+//Average kernel time of one statistic on the engine's resident dataset, after a warm up run
+double timeTunedKernel(WeatherStatsEngine& engine, const TunedKernel& tuned, int runs) {
+    DeviceDataset& dataset = engine.dataset();
+    double time = 0;
+    for (int r = 0; r <= runs; r++) {
+        int Kernel_time = 0, Total_mem_time = 0, Overall_time = 0;
+        if (tuned.vector_width == 1)
+            Kernel_time = engine.compute(STAT_ALL).kernel_time;
+        else
+            engine.reduce(tuned.name, dataset.temperatures(), dataset.size(), Kernel_time, Total_mem_time, Overall_time, tuned.vector_width);
+        if (r) //the first run is a warm up
+            time += (double)Kernel_time / runs;
+    }
+    return time;
+}
+
+//Sweep the launch settings of the reduction kernels on the context's device, using the given data:
+//   work-group size        powers of two from 16 up to what the device and every kernel allow
+//   groups per compute unit 1 to 64, which sets the elements each work-item loops over (N / (groups * work-group size))
+//   host-finish threshold  a range around the measured one, timed on the multi-pass min_reduce
+//Each work-group size needs its own build (the kernels are specialised with -DWG_SIZE), so every size gets a fresh
+//...engine. The work-group size with the lowest total over all kernels wins, and each kernel keeps its own best
+//...groups per compute unit at that size
+TuningProfile autotuneDevice(cl::Context context, const std::string& kernel_path, const float* values, size_t count, int runs = 5) {
+    cl::Device device = context.getInfo<CL_CONTEXT_DEVICES>()[0];
+    TuningProfile best;
+    best.device = deviceName(context);
+    best.driver = driverVersion(context);
+    if (!count)
+        return best;
+
+    size_t max_workgroup = std::min(device.getInfo<CL_DEVICE_MAX_WORK_GROUP_SIZE>(), (size_t)1024);
+    const size_t groups_per_cu_sweep[] = { 1, 2, 4, 8, 16, 32, 64 };
+    double best_total = std::numeric_limits<double>::infinity();
+    std::unique_ptr<WeatherStatsEngine> best_engine;
+
+    std::cout << "\nAutotuning " << best.device << " (driver " << best.driver << ") on " << count << " values" << std::endl;
+    for (size_t workgroupSize = 16; workgroupSize <= max_workgroup; workgroupSize *= 2) {
+        std::unique_ptr<WeatherStatsEngine> engine;
+        try {
+            engine.reset(new WeatherStatsEngine(context, kernel_path, workgroupSize));
+            engine->upload(values, count);
+
+            //a kernel's own limit can be lower than the device's (registers, local memory)
+            bool fits = true;
+            for (const TunedKernel& tuned : TUNED_KERNELS)
+                fits = fits && engine->kernel(tuned.name).getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device) >= workgroupSize;
+            if (!fits) {
+                std::cout << "  work-group size " << workgroupSize << ": too large for some kernels" << std::endl;
+                break;
+            }
+        }
+        catch (const cl::Error& err) {
+            std::cout << "  work-group size " << workgroupSize << ": " << err.what() << std::endl;
+            break;
+        }
+
+        TuningProfile candidate = best;
+        candidate.workgroup_size = workgroupSize;
+        double total = 0;
+        for (const TunedKernel& tuned : TUNED_KERNELS) {
+            KernelTuning& kernel_best = candidate.kernels[tuned.name];
+            kernel_best.time_ns = std::numeric_limits<double>::infinity();
+            size_t last_groups = 0;
+            for (size_t groups_per_cu : groups_per_cu_sweep) {
+                engine->setGroupsPerComputeUnit(tuned.name, groups_per_cu);
+                size_t groups = engine->stridedGroups(count, tuned.vector_width, tuned.name);
+                if (groups == last_groups) //capped by the data or STRIDED_MAX_GROUPS, more won't change anything
+                    break;
+                last_groups = groups;
+                double time = timeTunedKernel(*engine, tuned, runs);
+                if (time < kernel_best.time_ns) {
+                    kernel_best.time_ns = time;
+                    kernel_best.groups_per_compute_unit = groups_per_cu;
+                    kernel_best.elements_per_work_item = (double)count / (groups * workgroupSize);
+                }
+            }
+            engine->setGroupsPerComputeUnit(tuned.name, kernel_best.groups_per_compute_unit);
+            total += kernel_best.time_ns;
+        }
+        std::cout << "  work-group size " << workgroupSize << ": " << total << " ns for all kernels" << std::endl;
+
+        if (total < best_total) {
+            best_total = total;
+            best = candidate;
+            best_engine = std::move(engine);
+        }
+    }
+    if (!best_engine)
+        return best;
+
+    //the threshold only matters to the multi-pass driver, so it is timed on the one-value-per-work-item min_reduce,
+    //...wall clock including the read back and the host finish
+    size_t measured = best_engine->hostFinishThreshold();
+    double best_threshold_time = std::numeric_limits<double>::infinity();
+    for (size_t threshold = std::max(best.workgroup_size, measured / 16); threshold <= measured * 16; threshold *= 2) {
+        best_engine->setHostFinishThreshold(threshold);
+        double time = 0;
+        for (int r = 0; r <= runs; r++) {
+            int Kernel_time = 0, Total_mem_time = 0, Overall_time = 0;
+            auto start = std::chrono::high_resolution_clock::now();
+            const std::vector<float>& remaining = best_engine->reduce("min_reduce", best_engine->dataset().temperatures(), count, Kernel_time, Total_mem_time, Overall_time);
+            volatile float host_min = *std::min_element(remaining.begin(), remaining.end());
+            (void)host_min;
+            if (r)
+                time += std::chrono::duration<double, std::nano>(std::chrono::high_resolution_clock::now() - start).count() / runs;
+        }
+        if (time < best_threshold_time) {
+            best_threshold_time = time;
+            best.host_finish_threshold = threshold;
+        }
+        if (threshold >= count) //every larger threshold is a single read of the whole input
+            break;
+    }
+
+    std::cout << "Best: work-group size " << best.workgroup_size << ", host-finish threshold " << best.host_finish_threshold << std::endl;
+    for (const auto& kernel : best.kernels)
+        std::cout << "  " << kernel.first << ": " << kernel.second.groups_per_compute_unit << " groups per compute unit ("
+            << kernel.second.elements_per_work_item << " values per work-item), " << kernel.second.time_ns << " ns" << std::endl;
+    return best;
+}
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <initializer_list>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Utils.h"
+
+//A batch of commands enqueued without blocking, each one waiting on the events of the commands it depends on. The host
+//...builds the whole graph (uploads, kernels, read backs), then blocks once in wait(), after which every node's profiling
+//...times are available. On an in-order queue the wait lists only repeat the queue order, on an out-of-order queue they
+//...are what orders the commands, so the same graph runs on either. Given several queues, lane() picks the queue the
+//...next nodes go to, and a wait list can name nodes on any of them, so independent chains can run side by side.
+//Host memory passed to write() and read() must stay valid until wait() returns, and kernels may be reused between
+//...nodes because their arguments are captured when they are enqueued
+class CommandGraph {
+public:
+    typedef size_t Node;
+
+    struct NodeInfo {
+        std::string name;
+        bool kernel;
+        size_t lane;
+        cl::Event event;
+        cl_ulong start = 0;
+        cl_ulong end = 0;
+        int time() const { return (int)(end - start); }
+    };
+
+    explicit CommandGraph(cl::CommandQueue queue) : queues_(1, queue) {}
+    explicit CommandGraph(const std::vector<cl::CommandQueue>& queues) : queues_(queues) {}
+
+    //nodes added from now on go to queue 'index' (wrapping round the queues given), so a single queue takes every lane
+    void lane(size_t index) { lane_ = index % queues_.size(); }
+
+    Node write(const std::string& name, cl::Buffer& buffer, size_t bytes, const void* data, std::initializer_list<Node> after = {}) {
+        NodeInfo& node = add(name, false);
+        std::vector<cl::Event> wait_list = events(after);
+        queues_[lane_].enqueueWriteBuffer(buffer, CL_FALSE, 0, bytes, data, waitList(wait_list), &node.event);
+        return nodes_.size() - 1;
+    }
+
+    template <typename T>
+    Node fill(const std::string& name, cl::Buffer& buffer, T pattern, size_t bytes, std::initializer_list<Node> after = {}) {
+        NodeInfo& node = add(name, false);
+        std::vector<cl::Event> wait_list = events(after);
+        queues_[lane_].enqueueFillBuffer(buffer, pattern, 0, bytes, waitList(wait_list), &node.event);
+        return nodes_.size() - 1;
+    }
+
+    Node kernel(const std::string& name, cl::Kernel& kernel, const cl::NDRange& global, const cl::NDRange& local, std::initializer_list<Node> after = {}) {
+        NodeInfo& node = add(name, true);
+        std::vector<cl::Event> wait_list = events(after);
+        queues_[lane_].enqueueNDRangeKernel(kernel, cl::NullRange, global, local, waitList(wait_list), &node.event);
+        return nodes_.size() - 1;
+    }
+
+    Node read(const std::string& name, cl::Buffer& buffer, size_t bytes, void* data, std::initializer_list<Node> after = {}) {
+        NodeInfo& node = add(name, false);
+        std::vector<cl::Event> wait_list = events(after);
+        queues_[lane_].enqueueReadBuffer(buffer, CL_FALSE, 0, bytes, data, waitList(wait_list), &node.event);
+        return nodes_.size() - 1;
+    }
+
+    //The only blocking call: flushes the queues, waits for every node and collects their profiling times
+    void wait() {
+        if (nodes_.empty())
+            return;
+        std::vector<cl::Event> all;
+        for (const NodeInfo& node : nodes_)
+            all.push_back(node.event);
+        for (cl::CommandQueue& queue : queues_)
+            queue.flush(); //a node waiting on another queue's event only starts once that queue has been submitted
+        cl::Event::waitForEvents(all);
+        for (NodeInfo& node : nodes_) {
+            node.start = node.event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+            node.end = node.event.getProfilingInfo<CL_PROFILING_COMMAND_END>();
+        }
+    }
+
+    const std::vector<NodeInfo>& nodes() const { return nodes_; }
+
+    //sums of the node times after wait(), split like the rest of the program's timings
+    int kernelTime() const { return sum(true); }
+    int memTime() const { return sum(false); }
+
+    //device time from the first command starting to the last one ending. Less than kernelTime() + memTime() when
+    //...commands overlapped
+    int span() const {
+        if (nodes_.empty())
+            return 0;
+        cl_ulong first = nodes_[0].start, last = nodes_[0].end;
+        for (const NodeInfo& node : nodes_) {
+            first = std::min(first, node.start);
+            last = std::max(last, node.end);
+        }
+        return (int)(last - first);
+    }
+
+    //device time with at least one command running, and with two or more running at once, from the event timestamps
+    int busy() const { return activeTime(1); }
+    int overlapped() const { return activeTime(2); }
+
+    void report(std::ostream& out) const {
+        cl_ulong first = nodes_.empty() ? 0 : nodes_[0].start;
+        for (const NodeInfo& node : nodes_)
+            first = std::min(first, node.start);
+        for (const NodeInfo& node : nodes_) {
+            out << "  " << node.name << (node.kernel ? " (kernel" : " (transfer");
+            if (queues_.size() > 1)
+                out << ", queue " << node.lane;
+            out << "): " << node.time() << " ns, from " << node.start - first << " ns" << std::endl;
+        }
+    }
+
+private:
+    NodeInfo& add(const std::string& name, bool kernel) {
+        nodes_.push_back(NodeInfo());
+        nodes_.back().name = name;
+        nodes_.back().kernel = kernel;
+        nodes_.back().lane = lane_;
+        return nodes_.back();
+    }
+
+    std::vector<cl::Event> events(std::initializer_list<Node> after) const {
+        std::vector<cl::Event> wait_list;
+        for (Node node : after)
+            wait_list.push_back(nodes_.at(node).event);
+        return wait_list;
+    }
+
+    //an empty wait list has to be passed as NULL
+    static const std::vector<cl::Event>* waitList(const std::vector<cl::Event>& wait_list) {
+        return wait_list.empty() ? NULL : &wait_list;
+    }
+
+    int sum(bool kernels) const {
+        int total = 0;
+        for (const NodeInfo& node : nodes_) {
+            if (node.kernel == kernels)
+                total += node.time();
+        }
+        return total;
+    }
+
+    int activeTime(int at_least) const {
+        //sweep the start and end times in order, ends first where they meet so touching commands don't count as overlapping
+        std::vector<std::pair<cl_ulong, int>> edges;
+        for (const NodeInfo& node : nodes_) {
+            edges.push_back(std::make_pair(node.start, 1));
+            edges.push_back(std::make_pair(node.end, -1));
+        }
+        std::sort(edges.begin(), edges.end());
+        cl_ulong total = 0;
+        int running = 0;
+        for (size_t e = 0; e < edges.size(); e++) {
+            if (e && running >= at_least)
+                total += edges[e].first - edges[e - 1].first;
+            running += edges[e].second;
+        }
+        return (int)total;
+    }
+
+    std::vector<cl::CommandQueue> queues_;
+    size_t lane_ = 0;
+    std::vector<NodeInfo> nodes_;
+};
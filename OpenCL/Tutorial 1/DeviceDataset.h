@@ -0,0 +1,34 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+
+#include "Utils.h"
+
+//The temperature column copied to the device once and kept there for the whole run. Every statistic kernel reads
+//...this one buffer, instead of each statistic padding its own copy of the vector and uploading it again
+class DeviceDataset {
+public:
+    DeviceDataset(cl::Context context, cl::CommandQueue queue, const float* values, size_t count)
+        : size_(count) {
+        //a zero sized buffer is an error in OpenCL, keep one element so an empty dataset still gets a valid buffer
+        buffer_ = cl::Buffer(context, CL_MEM_READ_ONLY, std::max(count, (size_t)1) * sizeof(float));
+        if (count) {
+            cl::Event write_event;
+            queue.enqueueWriteBuffer(buffer_, CL_TRUE, 0, count * sizeof(float), values, NULL, &write_event);
+            upload_time_ = (int)(write_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - write_event.getProfilingInfo<CL_PROFILING_COMMAND_START>());
+        }
+    }
+
+    cl::Buffer& temperatures() { return buffer_; }
+    size_t size() const { return size_; }
+    size_t bytes() const { return size_ * sizeof(float); }
+
+    //time taken by the single upload, in ns
+    int uploadTime() const { return upload_time_; }
+
+private:
+    cl::Buffer buffer_;
+    size_t size_ = 0;
+    int upload_time_ = 0;
+};
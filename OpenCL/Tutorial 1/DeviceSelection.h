@@ -0,0 +1,181 @@
+#pragma once
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include "Utils.h"
+#include "TuningProfile.h"
+#include "MultiDevice.h"
+#include "WeatherStatsEngine.h"
+
+//The device the program runs on, as the (platform_id, device_id) pair GetContext takes, picked by probing every device.
+//Stored per host as a small JSON file:
+//   { "fingerprint": "...", "platform_id": 0, "device_id": 0, "device": "...", "values_per_ns": 1.25 }
+//The fingerprint lists every platform, device and driver version in enumeration order, so new hardware, a removed
+//...device or a driver update changes it and the next run probes again
+struct DeviceSelection {
+    std::string fingerprint;
+    int platform_id = -1;
+    int device_id = -1;
+    std::string device;
+    double values_per_ns = 0;
+
+    bool save(const std::string& path) const {
+        std::ofstream file(path);
+        if (!file)
+            return false;
+        file << "{\n";
+        file << "    \"fingerprint\": " << jsonQuote(fingerprint) << ",\n";
+        file << "    \"platform_id\": " << platform_id << ",\n";
+        file << "    \"device_id\": " << device_id << ",\n";
+        file << "    \"device\": " << jsonQuote(device) << ",\n";
+        file << "    \"values_per_ns\": " << values_per_ns << "\n";
+        file << "}\n";
+        return (bool)file;
+    }
+
+    bool load(const std::string& path) {
+        std::ifstream file(path);
+        if (!file)
+            return false;
+        std::stringstream contents;
+        contents << file.rdbuf();
+        std::string text = contents.str();
+
+        DeviceSelection selection;
+        double platform = -1, device_index = -1;
+        JsonReader json(text);
+        bool ok = json.object([&](const std::string& key) {
+            if (key == "fingerprint")
+                return json.string(selection.fingerprint);
+            if (key == "platform_id")
+                return json.number(platform);
+            if (key == "device_id")
+                return json.number(device_index);
+            if (key == "device")
+                return json.string(selection.device);
+            if (key == "values_per_ns")
+                return json.number(selection.values_per_ns);
+            return json.skip();
+        });
+        if (!ok || platform < 0 || device_index < 0)
+            return false;
+        selection.platform_id = (int)platform;
+        selection.device_id = (int)device_index;
+        *this = selection;
+        return true;
+    }
+};
+
+//Every platform and device with its driver version, in the order GetContext numbers them
+std::string deviceFingerprint() {
+    std::string fingerprint;
+    std::vector<cl::Platform> platforms;
+    cl::Platform::get(&platforms);
+    for (cl::Platform& platform : platforms) {
+        fingerprint += platform.getInfo<CL_PLATFORM_NAME>() + " " + platform.getInfo<CL_PLATFORM_VERSION>() + ":";
+        std::vector<cl::Device> devices;
+        try {
+            platform.getDevices(CL_DEVICE_TYPE_ALL, &devices);
+        }
+        catch (const cl::Error&) {
+        }
+        for (cl::Device& device : devices)
+            fingerprint += " " + device.getInfo<CL_DEVICE_NAME>() + " (" + device.getInfo<CL_DRIVER_VERSION>() + ")";
+        fingerprint += ";";
+    }
+    return fingerprint;
+}
+
+std::string hostName() {
+#ifdef _WIN32
+    const char* name = getenv("COMPUTERNAME");
+    return name ? name : "host";
+#else
+    char name[256] = {};
+    return gethostname(name, sizeof(name) - 1) == 0 && name[0] ? name : "host";
+#endif
+}
+
+//Selection file for this host, in the working directory, so a shared checkout keeps one per machine
+std::string deviceSelectionPath() {
+    return "device_selection_" + fileNameKey(hostName()) + ".json";
+}
+
+//Time every available device with a compiler on 'count' synthetic temperatures: the upload bandwidth and a fused
+//...reduction pass, the two costs of a run (measureThroughput). The device with the most values per ns wins.
+//Devices that fail to build are reported and skipped
+DeviceSelection probeDevices(const std::string& kernel_path, size_t workgroupSize, size_t count = 1 << 22) {
+    //whole tenths from -20.0 to 39.9, like the real data
+    std::vector<float> values(count);
+    for (size_t i = 0; i < count; i++)
+        values[i] = (float)((int)((i * 2654435761u) % 600) - 200) / 10.0f;
+
+    DeviceSelection best;
+    std::cout << "Probing OpenCL devices on " << count << " values" << std::endl;
+    std::vector<cl::Platform> platforms;
+    cl::Platform::get(&platforms);
+    for (int i = 0; i < (int)platforms.size(); i++) {
+        std::vector<cl::Device> devices;
+        try {
+            platforms[i].getDevices(CL_DEVICE_TYPE_ALL, &devices);
+        }
+        catch (const cl::Error&) {
+            continue;
+        }
+        for (int j = 0; j < (int)devices.size(); j++) {
+            std::string name = devices[j].getInfo<CL_DEVICE_NAME>();
+            if (!devices[j].getInfo<CL_DEVICE_AVAILABLE>() || !devices[j].getInfo<CL_DEVICE_COMPILER_AVAILABLE>())
+                continue;
+            try {
+                std::unique_ptr<WeatherStatsEngine> engine = createTunedEngine(cl::Context(devices[j]), kernel_path, workgroupSize);
+                double values_per_ns = measureThroughput(*engine, &values[0], count);
+                int upload_time = engine->dataset().uploadTime();
+                int kernel_time = engine->compute(STAT_ALL).kernel_time;
+                //bytes per ns are GB/s
+                std::cout << "  " << i << ":" << j << " " << name << ": upload " << (upload_time ? (double)count * sizeof(float) / upload_time : 0)
+                    << " GB/s, fused reduction " << (kernel_time ? (double)count * sizeof(float) / kernel_time : 0) << " GB/s, "
+                    << values_per_ns << " values/ns" << std::endl;
+                if (values_per_ns > best.values_per_ns || best.platform_id < 0) {
+                    best.platform_id = i;
+                    best.device_id = j;
+                    best.device = name;
+                    best.values_per_ns = values_per_ns;
+                }
+            }
+            catch (const cl::Error& err) {
+                std::cout << "  " << i << ":" << j << " " << name << ": skipped, " << err.what() << ", " << getErrorString(err.err()) << std::endl;
+            }
+        }
+    }
+    if (best.platform_id < 0)
+        throw std::runtime_error("No usable OpenCL devices");
+    return best;
+}
+
+//The device to run on: this host's saved selection while the devices and drivers are unchanged, otherwise (or with
+//...'reprobe') a fresh probe, which is then saved
+DeviceSelection selectDevice(const std::string& kernel_path, size_t workgroupSize, bool reprobe = false) {
+    std::string path = deviceSelectionPath();
+    std::string fingerprint = deviceFingerprint();
+    DeviceSelection selection;
+    if (!reprobe && selection.load(path) && selection.fingerprint == fingerprint) {
+        std::cout << "Using device selection " << path << std::endl;
+        return selection;
+    }
+
+    selection = probeDevices(kernel_path, workgroupSize);
+    selection.fingerprint = fingerprint;
+    if (selection.save(path))
+        std::cout << "Device selection saved to " << path << std::endl;
+    return selection;
+}
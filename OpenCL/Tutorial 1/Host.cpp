@@ -8,271 +8,292 @@
 #include <algorithm> 
 #include <math.h>  
 #include <chrono>  // for high_resolution_clock
+#include <thread>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <exception>
 
 #include "Utils.h"
+#include "MappedFile.h"
+#include "WeatherData.h"
+#include "WeatherCache.h"
+#include "DeviceDataset.h"
+#include "Moments.h"
+#include "WeatherStatsEngine.h"
+#include "TuningProfile.h"
+#include "Autotuner.h"
+#include "CommandGraph.h"
+#include "MultiDevice.h"
+#include "DeviceSelection.h"
 
 using namespace std;
 
 //General Methods
-vector<float> padding(vector<float> Temperatures, size_t workgroupSize, int initValue, bool sorting) {
-    
-    if (!sorting) {
-        size_t padding_size = Temperatures.size() % workgroupSize;
-
-        //if the input vector is not a multiple of the workgroupSize
-        //insert additional neutral elements (0 for addition) so that the total will not be affected
-        if (padding_size) {
-            std::vector<float> Temp_ext(workgroupSize - padding_size, initValue);
-            //append extra vector to our inputs
-            Temperatures.insert(Temperatures.end(), Temp_ext.begin(), Temp_ext.end());
-        }
-    }
-    //This section is triggered if we are using this padding method to pad a to-be-sorted array
-    //if we are we, not only do we need to make sure the vector length is a factor of 32 but also a power of 2 as...
-    //...bitonic sort only works with lengths of a power of 2. '32768' was used for the short dataset as its the closest
-    //...power of 2 and multiple of 32 to the vectors original length 
-    else {
-        size_t padding_size = 32768 - Temperatures.size();
-        std::vector<float> Temp_ext(padding_size, initValue);
-        //append extra vector to our inputs
-        Temperatures.insert(Temperatures.end(), Temp_ext.begin(), Temp_ext.end());
-    }
+//Given 'source', the file's size, time and hash are recorded there for the column cache: the size and time before
+//...the file is mapped, the hash from the mapping the parse reads
+void readFile(WeatherTable& table, const string& path = "temp_lincolnshire_datasets/temp_lincolnshire.txt", WeatherCacheSource* source = NULL) {
 
-    return Temperatures;
+    cout << "******READING FILE*******" << endl;
+    auto start = chrono::high_resolution_clock::now();
+
+    // Map the text file into memory and scan the bytes in place - no getline/substr/atof per row.
+    // All six columns are kept, in one array per column
+    if (source)
+        sourceStatus(path, source->size, source->mtime); //a missing file throws from MappedFile
+    MappedFile file(path);
+    if (source)
+        source->hash = hashBytes(file.data(), file.size());
+    table.clear();
+    parseWeatherTable(file.data(), file.size(), table);
+
+    auto parse_time = chrono::duration_cast<chrono::milliseconds>(chrono::high_resolution_clock::now() - start).count();
+    cout << "Extracted " << table.size() << " records from " << table.station_names.size() << " stations (" << file.size() << " bytes) in " << parse_time << " ms" << endl;
 }
 
-void readFile(vector<float>& Temperatures_unpadded) {
-
-    // Read from the text file
-    ifstream file("temp_lincolnshire_datasets/temp_lincolnshire.txt");
-    string line;
+void readFileParallel(WeatherTable& table, unsigned int threads, const string& path = "temp_lincolnshire_datasets/temp_lincolnshire.txt",
+    WeatherCacheSource* source = NULL) {
 
     cout << "******READING FILE*******" << endl;
-    cout << "Extracting temperatures from file, will take around 30 seconds..." << endl;
-    // Use a while loop together with the getline() function to read the file line by line
-    while (getline(file, line)) {
-        //split the contents of the line to extract the temperature value
-        size_t found = line.find_last_of(' ');
-        string tempStr = line.substr(found);
-        float temp = atof(tempStr.c_str());
-        Temperatures_unpadded.push_back(temp);
-    }
+    auto start = chrono::high_resolution_clock::now();
+
+    // Same as readFile but the mapped bytes are split at line boundaries and parsed on 'threads' threads
+    if (source)
+        sourceStatus(path, source->size, source->mtime);
+    MappedFile file(path);
+    if (source)
+        source->hash = hashBytes(file.data(), file.size());
+    table.clear();
+    parseWeatherTableParallel(file.data(), file.size(), table, threads);
+
+    auto parse_time = chrono::duration_cast<chrono::milliseconds>(chrono::high_resolution_clock::now() - start).count();
+    cout << "Extracted " << table.size() << " records from " << table.station_names.size() << " stations (" << file.size() << " bytes) on " << threads << " threads in " << parse_time << " ms" << endl;
+}
 
-    file.close();
+void loadDataset(WeatherTable& table, unsigned int threads, bool use_cache, const string& path = "temp_lincolnshire_datasets/temp_lincolnshire.txt") {
+    // Use the binary column cache next to the text file when it is up to date - the columns are mapped straight
+    // from disk with no parsing at all. Otherwise parse the text and (re)write the cache for next time
+    if (use_cache) {
+        auto start = chrono::high_resolution_clock::now();
+        if (loadWeatherCache(path, table)) {
+            auto load_time = chrono::duration_cast<chrono::milliseconds>(chrono::high_resolution_clock::now() - start).count();
+            cout << "******READING CACHE*******" << endl;
+            cout << "Mapped " << table.size() << " records from " << table.station_names.size() << " stations out of " << cachePathFor(path) << " in " << load_time << " ms" << endl;
+            return;
+        }
+    }
 
-    cout << "Temperatures extracted sucessfully" << endl;
+    WeatherCacheSource source;
+    if (threads > 1)
+        readFileParallel(table, threads, path, use_cache ? &source : NULL);
+    else
+        readFile(table, path, use_cache ? &source : NULL);
+
+    if (use_cache) {
+        if (writeWeatherCache(path, table, source))
+            cout << "Wrote column cache " << cachePathFor(path) << endl;
+        else
+            cout << "Could not write column cache " << cachePathFor(path) << endl;
+    }
 }
 
+void benchmarkParsers(const string& path, unsigned int threads) {
+    //Microbenchmark of every way of extracting the temperature column, reported as parse throughput.
+    //'getline + atof' is the original readFile loop and is kept here only as the baseline to compare against
+    cout << "******PARSER BENCHMARK*******" << endl;
+    MappedFile file(path);
+    const int repeats = 3;
+
+    auto report = [&](const string& name, const function<size_t()>& run) {
+        double best = 1e30;
+        size_t rows = 0;
+        for (int r = 0; r < repeats; r++) {
+            auto start = chrono::high_resolution_clock::now();
+            rows = run();
+            best = min(best, chrono::duration<double>(chrono::high_resolution_clock::now() - start).count());
+        }
+        printf("%-28s %10zu rows %9.2f ms %8.3f GB/s\n", name.c_str(), rows, best * 1000, file.size() / best / 1e9);
+    };
+
+    report("getline + atof (original)", [&]() {
+        vector<float> Temperatures;
+        ifstream text(path);
+        string line;
+        while (getline(text, line)) {
+            size_t found = line.find_last_of(' ');
+            string tempStr = line.substr(found);
+            Temperatures.push_back(atof(tempStr.c_str()));
+        }
+        return Temperatures.size();
+    });
+
+    for (int level = SIMD_SCALAR; level <= activeSimdLevel(); level++) {
+        report(string("mmap + ") + simdLevelName((SimdLevel)level), [&]() {
+            vector<float> Temperatures;
+            return parseTemperatures(file.data(), file.size(), Temperatures, (SimdLevel)level);
+        });
+    }
 
+    report("mmap + " + string(simdLevelName(activeSimdLevel())) + " x " + to_string(threads) + " threads", [&]() {
+        vector<float> Temperatures;
+        return parseTemperaturesParallel(file.data(), file.size(), Temperatures, threads);
+    });
+
+    //same again but decoding all six columns into the WeatherTable
+    for (int level = SIMD_SCALAR; level <= activeSimdLevel(); level++) {
+        report(string("all columns + ") + simdLevelName((SimdLevel)level), [&]() {
+            WeatherTable table;
+            return parseWeatherTable(file.data(), file.size(), table, (SimdLevel)level);
+        });
+    }
 
-//Optimised Methods
-void minimum(std::vector<float> Temperatures_unpadded, cl::Context context, cl::Program program, size_t workgroupSize, cl::CommandQueue queue,
-    int &Kernel_time, int &Total_mem_time, int &Overall_time, int counter) {
-    // Find the min element
-    // pad the vector so its length is adequate for the number of work groups
-    // value '1000' is used so the new padded elements dont get in the way of finding the min
-    vector<float> Temperatures_min = padding(Temperatures_unpadded, workgroupSize, 1000, false);
-
-    size_t vector_elements = Temperatures_min.size();
-    size_t vector_size = Temperatures_min.size() * sizeof(float);
+    report("all columns x " + to_string(threads) + " threads", [&]() {
+        WeatherTable table;
+        return parseWeatherTableParallel(file.data(), file.size(), table, threads);
+    });
+}
 
-    //with each reduction the output produced is the input divided by 32, therefore for efficieny we re-size the output vector...
-    //...on each run. Means there is no wasted memory.
-    std::vector<float> Output_min(vector_elements/32, 1000); 
-    size_t output_size_min = Output_min.size() * sizeof(float);
 
-    cl::Buffer buffer_Temp_min(context, CL_MEM_READ_WRITE, vector_size);
-    cl::Buffer buffer_Out_min(context, CL_MEM_READ_WRITE, output_size_min);
 
-    cl::Event write_event;
+//Exact fixed-point sums
+//the program is built with -DINT64_ATOMICS when the device supports them, see main
+bool built_with_int64_atomics(cl::Context context, cl::Program program) {
+    cl::Device device = context.getInfo<CL_CONTEXT_DEVICES>()[0];
+    return program.getBuildInfo<CL_PROGRAM_BUILD_OPTIONS>(device).find("-DINT64_ATOMICS") != string::npos;
+}
 
-    // copy to device memory
-    queue.enqueueWriteBuffer(buffer_Temp_min, CL_TRUE, 0, vector_size, &Temperatures_min[0], NULL, &write_event);
-    queue.enqueueFillBuffer(buffer_Out_min, 0, 0, output_size_min);
+long long reduce_fixed_sum(WeatherStatsEngine& engine, cl::Buffer& buffer_values, size_t vector_elements, float scale,
+    int& Kernel_time, int& Total_mem_time, int& Overall_time, bool squares = false) {
+    //Sum of vector_elements floats already on the device, each scaled by 'scale' and rounded to a 64 bit integer.
+    //This replaces splitting every work-group sum into an int part and a decimal part and atomic_add'ing both into...
+    //...int32 counters, which dropped precision on every group and overflowed on large datasets. The sum is exact and
+    //...one launch covers any number of rows.
+    //With 'squares' the rounded values are squared before they are added (sumsq_fixed).
+    //The kernel and the output buffer come from the engine, so a repeated query pays for the launch and the read only
+    cl::CommandQueue queue = engine.queue();
+    size_t workgroupSize = engine.workgroupSize();
+    const char* kernel_name = squares ? "sumsq_fixed" : "reduce_fixed";
+    bool atomics = built_with_int64_atomics(engine.context(), engine.program());
+    size_t groups = engine.stridedGroups(vector_elements, 1, kernel_name);
+
+    std::vector<cl_long> Output(atomics ? 1 : groups, 0);
+    size_t output_size = Output.size() * sizeof(cl_long);
+
+    cl::Buffer buffer_Out = engine.buffers().acquire(output_size);
+    if (atomics)
+        queue.enqueueFillBuffer(buffer_Out, (cl_long)0, 0, output_size); //zero the single accumulator
 
     // setup kenerl
-    cl::Kernel kernel_min = cl::Kernel(program, "min_reduce");
-    kernel_min.setArg(0, buffer_Temp_min);
-    kernel_min.setArg(1, buffer_Out_min);
-    kernel_min.setArg(2, cl::Local(workgroupSize * sizeof(float)));//local memory size
+    cl::Kernel& kernel_reduce = engine.kernel(kernel_name);
+    kernel_reduce.setArg(0, buffer_values);
+    kernel_reduce.setArg(1, (cl_ulong)vector_elements);
+    kernel_reduce.setArg(2, scale);
+    kernel_reduce.setArg(3, buffer_Out);
+    kernel_reduce.setArg(4, cl::Local(workgroupSize * sizeof(cl_long)));//local memory size
 
     cl::Event kernel_event;
 
     // execute kernel
-    queue.enqueueNDRangeKernel(kernel_min, cl::NullRange, cl::NDRange(vector_elements), cl::NDRange(workgroupSize), NULL, &kernel_event);
+    queue.enqueueNDRangeKernel(kernel_reduce, cl::NullRange, cl::NDRange(groups * workgroupSize), cl::NDRange(workgroupSize), NULL, &kernel_event);
 
     cl::Event read_event;
 
     // Read output of kernel
-    queue.enqueueReadBuffer(buffer_Out_min, CL_TRUE, 0, output_size_min, &Output_min[0], NULL, &read_event);
+    queue.enqueueReadBuffer(buffer_Out, CL_TRUE, 0, output_size, &Output[0], NULL, &read_event);
+    engine.buffers().release(buffer_Out);
 
-    //calculate performance times
-    int write_time = write_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - write_event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
     int read_time = read_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - read_event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+    int Current_Kernel_Time = kernel_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - kernel_event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
 
-    int Current_Kernel_Time = kernel_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - kernel_event.getProfilingInfo<CL_PROFILING_COMMAND_START>();;
-    int Current_mem_time = write_time + read_time;
+    Kernel_time += Current_Kernel_Time;
+    Total_mem_time += read_time;
+    Overall_time += Current_Kernel_Time + read_time;
 
-    Kernel_time += kernel_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - kernel_event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
-    Total_mem_time += write_time + read_time;
-    Overall_time += Current_mem_time + Current_Kernel_Time;
+    //second level of the reduction when there are no atomics - at most STRIDED_MAX_GROUPS integer adds
+    long long sum = 0;
+    for (cl_long group_sum : Output)
+        sum += group_sum;
+    return sum;
+}
 
-    // reduce temperatures vector an additional 3 times until there are < 64 items left in vector
-    if (counter < 2) {
-        counter++;
-        minimum(Output_min, context, program, workgroupSize, queue, Kernel_time, Total_mem_time, Overall_time, counter);
-    }
-    // when there are only a handful of items left in vector it is not efficient to run min calculation in parallel. The time taken to transfer data to device and execute kernel >
-    // ...the time taken to calculate the min sequentially. Therefore we simply calculate the min from this small sample size sequentially
-    else {
-        float minTemp = 1000;
-        for (int k = 0; k < Output_min.size(); ++k) {
-            if (Output_min[k] < minTemp) {
-                minTemp = Output_min[k];
-            }
-        }
-        cout << "Calculated Min = " << minTemp << endl;
-    }
+//Sum of squared differences from the mean, S2 - S1^2/N, of N whole numbers with sum S1 and sum of squares S2. S1^2 doesn't
+//...fit 64 bits, so S1 is split as q*N + r and S1^2/N = S1*q + q*r + r^2/N. Everything but r^2/N, which is less than N,
+//...is an exact integer, so the result only carries double rounding on that last term and on the final conversion
+double fixed_squared_deviations(long long sum, long long sumsq, size_t count) {
+    if (!count)
+        return 0;
+    long long n = (long long)count;
+    long long q = sum / n, r = sum % n;
+    return (double)(sumsq - sum * q - q * r) - (double)r * ((double)r / n);
+}
+
+//Optimised Methods
+float minimum(WeatherStatsEngine& engine, cl::Buffer& buffer_Temp_min, size_t vector_elements, int &Kernel_time, int &Total_mem_time, int &Overall_time, bool vectorised = false) {
+    // Find the min element
+    // The input is already on the device - the resident dataset, or a copy made by minimum_non_optimised.
+    // min_reduce is run by the engine's multi-pass driver: every pass reduces each work-group to one value, ping-ponging
+    // ...between two device buffers, until there are few enough values left that finishing on the host is quicker.
+    // 'vectorised' uses min_reduce_vec instead: float4 loads in a grid-stride loop, launched per compute unit rather than per value
+    const std::vector<float>& Output_min = vectorised
+        ? engine.reduce("min_reduce_vec", buffer_Temp_min, vector_elements, Kernel_time, Total_mem_time, Overall_time, 4)
+        : engine.reduce("min_reduce", buffer_Temp_min, vector_elements, Kernel_time, Total_mem_time, Overall_time);
+
+    float minTemp = Output_min.empty() ? INFINITY : *std::min_element(Output_min.begin(), Output_min.end());
+    cout << "Calculated Min = " << minTemp << endl;
+    return minTemp;
 }
 
-void mean(std::vector<float> Temperatures_unpadded, cl::Context context, cl::Program program, size_t workgroupSize,
-    cl::CommandQueue queue, float& Mean, int& Kernel_time, int& Total_mem_time, int& Overall_time, bool optimised) {
+void mean(WeatherStatsEngine& engine, cl::Buffer& buffer_Temp, size_t vector_elements, float& Mean, int& Kernel_time, int& Total_mem_time,
+    int& Overall_time, bool optimised) {
     //mean value is passed by reference so it can be altered and used later on in the SD calculations
     cout << "\n******MEAN******" << endl;
     cout << "Note: This function is identical on the optimised and non-optimised algorithm varients" << endl;
-    // The mean is calculated in parallel by splitting the reduction results into integer and decimal components
-    // The kernel approach used was one output array where Output[0] would contain integer reduction and Output[1] the decimal reduction
-    // Unfortunatley I could not find any futhur optimisations to this approach and therefore both the optimised and non-optimised varients utilise this same function
-    vector<float> Temperatures = padding(Temperatures_unpadded, workgroupSize, 0, false); 
-    //array padded with 0's to make sure its the right size for the workgroup size - 0s wont affect the mean calculation
-
-    size_t vector_elements = Temperatures.size();//number of elements
-    size_t vector_size = Temperatures.size() * sizeof(float);
-
-    std::vector<int> Output(2); // only has two elements - Int sum and decimal sum
-    size_t output_size = Output.size() * sizeof(float);//size in bytes
-
-    // Buffers
-    cl::Buffer buffer_Temp(context, CL_MEM_READ_WRITE, vector_size);
-    cl::Buffer buffer_Out(context, CL_MEM_READ_WRITE, output_size);
-
-    cl::Event write_event;
-
-    // copy to device memory
-    queue.enqueueWriteBuffer(buffer_Temp, CL_TRUE, 0, vector_size, &Temperatures[0], NULL, &write_event);
-    queue.enqueueFillBuffer(buffer_Out, 0, 0, output_size); //zero buffer on device memory
-
-    // setup kenerl
-    cl::Kernel kernel_reduce = cl::Kernel(program, "reduce_atomic_single_array");
-    kernel_reduce.setArg(0, buffer_Temp);
-    kernel_reduce.setArg(1, buffer_Out);
-    kernel_reduce.setArg(2, cl::Local(workgroupSize * sizeof(float)));//local memory size
-
-    cl::Event kernel_event;
-
-    // execute kernel
-    queue.enqueueNDRangeKernel(kernel_reduce, cl::NullRange, cl::NDRange(vector_elements), cl::NDRange(workgroupSize), NULL, &kernel_event);
-
-    cl::Event read_event;
-
-    // Read output of kernel
-    queue.enqueueReadBuffer(buffer_Out, CL_TRUE, 0, output_size, &Output[0], NULL, &read_event);
+    // The mean is calculated from an exact fixed-point sum. Every temperature has one decimal place, so scaled by 10...
+    // ...it is a whole number and reduce_fixed adds them up as 64 bit integers, then the host divides once at the end.
+    // The temperatures are already on the device and the kernel is told the number of elements, so nothing is padded or copied
+    long long sum = reduce_fixed_sum(engine, buffer_Temp, vector_elements, 10.0f, Kernel_time, Total_mem_time, Overall_time);
 
     //sequentially calculate mean
     //...no need for this to be parallel as its quick n simple. Parallel would actually slow it down due to copying of data
-    float decimal_sum = ((float)Output[1]) / 10;
-    Mean = ((float)Output[0] + decimal_sum) / vector_elements;
+    Mean = (float)((double)sum / 10 / vector_elements);
 
     cout << "\nCalculated Mean: ";
     printf("%.1f", Mean);
 
-    Kernel_time = kernel_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() -
-        kernel_event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
-
-    int write_time = write_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - write_event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
-    int read_time = read_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - read_event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
-    Total_mem_time = write_time + read_time;
-    Overall_time = Total_mem_time + Kernel_time;
-
     std::cout << "\n\nKernel execution time [ns]: " << Kernel_time << std::endl;
     std::cout << "Total memory transfer time [ns]: " << Total_mem_time << std::endl;
     std::cout << "Overall Opetation Time [ns]: " << Overall_time << std::endl;
-
-    std::cout << GetFullProfilingInfo(kernel_event, ProfilingResolution::PROF_US) << std::endl;
 }
 
-void maximum(std::vector<float> Temperatures_unpadded, cl::Context context, cl::Program program, size_t workgroupSize, cl::CommandQueue queue,
-    int& Kernel_time, int& Total_mem_time, int& Overall_time, int counter) {
-    //pad vector with -1000 so it is an adequate size for the number of work groups. values of -1000 will not get in the way of calculating max
-    vector<float> Temperatures_max = padding(Temperatures_unpadded, workgroupSize, -1000, false);
-
-    size_t vector_elements = Temperatures_max.size();
-    size_t vector_size = Temperatures_max.size() * sizeof(float);
-
-    //with each reduction the output produced is the input divided by 32, therefore for efficieny we re-size the output vector...
-    //...on each run. Means there is no wasted memory.
-    std::vector<float> Output_max(vector_elements / 32, 1000);
-    size_t output_size_max = Output_max.size() * sizeof(float);
-
-    cl::Buffer buffer_Temp_max(context, CL_MEM_READ_WRITE, vector_size);
-    cl::Buffer buffer_Out_max(context, CL_MEM_READ_WRITE, output_size_max);
-
-    cl::Event write_event;
-
-    // copy to device memory
-    queue.enqueueWriteBuffer(buffer_Temp_max, CL_TRUE, 0, vector_size, &Temperatures_max[0], NULL, &write_event);
-    queue.enqueueFillBuffer(buffer_Out_max, 0, 0, output_size_max);
-
-    // setup kenerl
-    cl::Kernel kernel_max = cl::Kernel(program, "max_reduce");
-    kernel_max.setArg(0, buffer_Temp_max);
-    kernel_max.setArg(1, buffer_Out_max);
-    kernel_max.setArg(2, cl::Local(workgroupSize * sizeof(float)));//local memory size
-
-    cl::Event kernel_event;
-
-    // execute kernel
-    queue.enqueueNDRangeKernel(kernel_max, cl::NullRange, cl::NDRange(vector_elements), cl::NDRange(workgroupSize), NULL, &kernel_event);
-
-    cl::Event read_event;
-
-    // Read output of kernel
-    queue.enqueueReadBuffer(buffer_Out_max, CL_TRUE, 0, output_size_max, &Output_max[0], NULL, &read_event);
-
-    int write_time = write_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - write_event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
-    int read_time = read_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - read_event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
-
-    int Current_Kernel_Time = kernel_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - kernel_event.getProfilingInfo<CL_PROFILING_COMMAND_START>();;
-    int Current_mem_time = write_time + read_time;
-
-    Kernel_time += kernel_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - kernel_event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
-    Total_mem_time += write_time + read_time;
-    Overall_time += Current_mem_time + Current_Kernel_Time;
-
-    if (counter < 2) {
-        counter++;
-        maximum(Output_max, context, program, workgroupSize, queue, Kernel_time, Total_mem_time, Overall_time, counter);
-    }
-    else {
-        float maxTemp = -1000;
-        for (int k = 0; k < Output_max.size(); ++k) {
-            if (Output_max[k] > maxTemp) {
-                maxTemp = Output_max[k];
-            }
-        }
-        cout << "Calculated Max = " << maxTemp << endl;
-    }
+float maximum(WeatherStatsEngine& engine, cl::Buffer& buffer_Temp_max, size_t vector_elements, int &Kernel_time, int &Total_mem_time, int &Overall_time, bool vectorised = false) {
+    // Find the max element
+    // The input is already on the device - the resident dataset, or a copy made by maximum_non_optimised.
+    // max_reduce is run by the engine's multi-pass driver: every pass reduces each work-group to one value, ping-ponging
+    // ...between two device buffers, until there are few enough values left that finishing on the host is quicker.
+    // 'vectorised' uses max_reduce_vec instead: float4 loads in a grid-stride loop, launched per compute unit rather than per value
+    const std::vector<float>& Output_max = vectorised
+        ? engine.reduce("max_reduce_vec", buffer_Temp_max, vector_elements, Kernel_time, Total_mem_time, Overall_time, 4)
+        : engine.reduce("max_reduce", buffer_Temp_max, vector_elements, Kernel_time, Total_mem_time, Overall_time);
+
+    float maxTemp = Output_max.empty() ? -INFINITY : *std::max_element(Output_max.begin(), Output_max.end());
+    cout << "Calculated Max = " << maxTemp << endl;
+    return maxTemp;
 }
 
-void reduce_add_non_optimised(std::vector<float> Temperatures_unpadded, cl::Context context, cl::Program program, size_t workgroupSize, cl::CommandQueue queue,
-    int& Kernel_time, int& Total_mem_time, int& Overall_time, int counter, float sampleSize) {
+void reduce_add_non_optimised(WeatherStatsEngine& engine, std::vector<float> Temperatures_unpadded, int& Kernel_time, int& Total_mem_time, int& Overall_time, float sampleSize) {
     //Step 2
-    vector<float> Temperatures_reduce = padding(Temperatures_unpadded, workgroupSize, 0, false);
+    cl::Context context = engine.context();
+    cl::Program program = engine.program();
+    cl::CommandQueue queue = engine.queue();
+    size_t workgroupSize = engine.workgroupSize();
 
-    size_t vector_elements = Temperatures_reduce.size();
-    size_t vector_size = Temperatures_reduce.size() * sizeof(float);
+    // reduce is told the real element count, so the input is uploaded as it is and only the launch is rounded up
+    size_t vector_elements = Temperatures_unpadded.size();
+    size_t global_elements = (vector_elements + workgroupSize - 1) / workgroupSize * workgroupSize;
+    size_t vector_size = Temperatures_unpadded.size() * sizeof(float);
 
-    std::vector<float> Output_reduce(vector_elements, 1000);
+    std::vector<float> Output_reduce(global_elements);
     size_t output_size_reduce = Output_reduce.size() * sizeof(float);
 
     cl::Buffer buffer_Temp_reduce(context, CL_MEM_READ_WRITE, vector_size);
@@ -281,19 +302,20 @@ void reduce_add_non_optimised(std::vector<float> Temperatures_unpadded, cl::Cont
     cl::Event write_event;
 
     // copy to device memory
-    queue.enqueueWriteBuffer(buffer_Temp_reduce, CL_TRUE, 0, vector_size, &Temperatures_reduce[0], NULL, &write_event);
+    queue.enqueueWriteBuffer(buffer_Temp_reduce, CL_TRUE, 0, vector_size, &Temperatures_unpadded[0], NULL, &write_event);
     queue.enqueueFillBuffer(buffer_Out_reduce, 0, 0, output_size_reduce);
 
     // setup kenerl
     cl::Kernel kernel_sd = cl::Kernel(program, "reduce");
     kernel_sd.setArg(0, buffer_Temp_reduce);
-    kernel_sd.setArg(1, buffer_Out_reduce);
-    kernel_sd.setArg(2, cl::Local(workgroupSize * sizeof(float)));//local memory size
+    kernel_sd.setArg(1, (int)vector_elements);
+    kernel_sd.setArg(2, buffer_Out_reduce);
+    kernel_sd.setArg(3, cl::Local(workgroupSize * sizeof(float)));//local memory size
 
     cl::Event kernel_event;
 
     // execute kernel
-    queue.enqueueNDRangeKernel(kernel_sd, cl::NullRange, cl::NDRange(vector_elements), cl::NDRange(workgroupSize), NULL, &kernel_event);
+    queue.enqueueNDRangeKernel(kernel_sd, cl::NullRange, cl::NDRange(global_elements), cl::NDRange(workgroupSize), NULL, &kernel_event);
 
     cl::Event read_event;
 
@@ -310,225 +332,315 @@ void reduce_add_non_optimised(std::vector<float> Temperatures_unpadded, cl::Cont
     Total_mem_time += write_time + read_time;
     Overall_time += Current_mem_time + Current_Kernel_Time;
 
-    //run the reduction pattern again to futhur reduce the vector
-    if (counter < 5) {
-        counter++;
-        reduce_add_non_optimised(Output_reduce, context, program, workgroupSize, queue, Kernel_time, Total_mem_time, Overall_time, counter, sampleSize);
-    }
-    else {
-        //Step 3
-        //with the sum complete, divide by sample size and square root for final SD
-        float sd = sqrt((Output_reduce[0] / sampleSize));
-        cout << "Calculated SD = ";
-        printf("%.1f",sd);
-    }
-}
-
-void reduce_add_optimised(std::vector<float> Temperatures_unpadded, cl::Context context, cl::Program program, size_t workgroupSize, cl::CommandQueue queue,
-    int& Kernel_time, int& Total_mem_time, int& Overall_time, int counter, float sampleSize) {
-    //Step 2
-
-    //This kernel is more efficient than its counterpart due to it not having excess transfer and memory time caused by running...
-    //...multiple kernels. Instead it uses atomic functions which, although in-efficient, actually prove to be better for this dataset
-    vector<float> Temperatures_reduce = padding(Temperatures_unpadded, workgroupSize, 0, false);
-
-    size_t vector_elements = Temperatures_reduce.size();
-    size_t vector_size = Temperatures_reduce.size() * sizeof(float);
-
-    std::vector<int> Output_reduce(2);
-    size_t output_size_reduce = Output_reduce.size() * sizeof(float);
-
-    cl::Buffer buffer_Temp_reduce(context, CL_MEM_READ_WRITE, vector_size);
-    cl::Buffer buffer_Out_reduce(context, CL_MEM_READ_WRITE, output_size_reduce);
-
-    cl::Event write_event;
-
-    // copy to device memory
-    queue.enqueueWriteBuffer(buffer_Temp_reduce, CL_TRUE, 0, vector_size, &Temperatures_reduce[0], NULL, &write_event);
-    queue.enqueueFillBuffer(buffer_Out_reduce, 0, 0, output_size_reduce);
-
-    // setup kenerl
-    cl::Kernel kernel_sd = cl::Kernel(program, "reduce_2");
-    kernel_sd.setArg(0, buffer_Temp_reduce);
-    kernel_sd.setArg(1, buffer_Out_reduce);
-    kernel_sd.setArg(2, cl::Local(workgroupSize * sizeof(float)));//local memory size
+    //run the reduction pattern again to futhur reduce the vector - the per-group sums are uploaded again and the...
+    //...engine's multi-pass driver keeps reducing them until finishing on the host is quicker
+    size_t groups = global_elements / workgroupSize;
+    DeviceDataset next(context, queue, &Output_reduce[0], groups);
+    Total_mem_time += next.uploadTime();
+    Overall_time += next.uploadTime();
+    const std::vector<float>& Remaining = engine.reduce("reduce", next.temperatures(), next.size(), Kernel_time, Total_mem_time, Overall_time);
 
-    cl::Event kernel_event;
-
-    // execute kernel
-    queue.enqueueNDRangeKernel(kernel_sd, cl::NullRange, cl::NDRange(vector_elements), cl::NDRange(workgroupSize), NULL, &kernel_event);
-
-    cl::Event read_event;
-#
-    // Read output of kernel
-    queue.enqueueReadBuffer(buffer_Out_reduce, CL_TRUE, 0, output_size_reduce, &Output_reduce[0], NULL, &read_event);
+    //Step 3
+    double sumSq = 0;
+    for (float partial : Remaining)
+        sumSq += partial;
+    //with the sum complete, divide by sample size and square root for final SD
+    float sd = (float)sqrt(sumSq / sampleSize);
+    cout << "Calculated SD = ";
+    printf("%.1f",sd);
+}
 
-    int write_time = write_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - write_event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
-    int read_time = read_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - read_event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+void reduce_add_optimised(WeatherStatsEngine& engine, cl::Buffer& buffer_Temp_reduce, size_t vector_elements,
+    int& Kernel_time, int& Total_mem_time, int& Overall_time, float sampleSize) {
+    //Steps 1 and 2
 
-    int Current_Kernel_Time = kernel_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - kernel_event.getProfilingInfo<CL_PROFILING_COMMAND_START>();;
-    int Current_mem_time = write_time + read_time;
-
-    Kernel_time += kernel_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - kernel_event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
-    Total_mem_time += write_time + read_time;
-    Overall_time += Current_mem_time + Current_Kernel_Time;
+    //This is more efficient than its counterpart as there is no map at all: the temperatures x10 are whole numbers, so...
+    //...reduce_fixed and sumsq_fixed add them and their squares up exactly as 64 bit integers, and the squared differences
+    //...from the mean come out of those two sums (fixed_squared_deviations). Nothing is written out but the partial sums,
+    //...and no rounded mean enters the result
+    long long sum = reduce_fixed_sum(engine, buffer_Temp_reduce, vector_elements, 10.0f, Kernel_time, Total_mem_time, Overall_time);
+    long long sumsq = reduce_fixed_sum(engine, buffer_Temp_reduce, vector_elements, 10.0f, Kernel_time, Total_mem_time, Overall_time, true);
 
     //Step 3
-    float decimal_sum = ((float)Output_reduce[1]) / 10;
-    float sumSq = ((float)Output_reduce[0] + decimal_sum);
+    double sumSq = fixed_squared_deviations(sum, sumsq, vector_elements) / 100;
     //with the sum complete, divide by sample size and square root for final SD
-    float sd = sqrt((sumSq / sampleSize));
+    float sd = (float)sqrt(sumSq / sampleSize);
     cout << "Calculated SD = ";
     printf("%.1f", sd);
 }
 
-void sd(std::vector<float> Temperatures_unpadded, cl::Context context, cl::Program program, size_t workgroupSize, cl::CommandQueue queue,
+void sd(WeatherStatsEngine& engine, cl::Buffer& buffer_Temp_sd, size_t vector_elements,
     int& Kernel_time, int& Total_mem_time, int& Overall_time, float Mean, float sampleSize, bool optimised) {
+    cl::Context context = engine.context();
+    cl::Program program = engine.program();
+    cl::CommandQueue queue = engine.queue();
+    size_t workgroupSize = engine.workgroupSize();
+
     // The SD is a three step process
     // 1. Use the map pattern to calculate (each item - mean)^2
     // 2. Take these new values and perform a reduction pattern to add them together
     // 3. sequentially calculate the SD by dividing this sum by the number of items in the un-padded vector and square rooting the answer
 
-    // Step 1
-    // save the unpadded size so we can divide the sum later on by the correct value
-    size_t vector_elements_before_padding = Temperatures_unpadded.size();
-    vector<float> Temperatures_sd = padding(Temperatures_unpadded, workgroupSize, 0, false);
-
-    size_t vector_elements = Temperatures_sd.size();
-    size_t vector_size = Temperatures_sd.size() * sizeof(float);
-
-    std::vector<float> Output_sd(vector_elements, 0);
-    size_t output_size_sd = Output_sd.size() * sizeof(float);
+    if (optimised) {
+        //steps 1 and 2 fused on the device, only the final sum is read back
+        reduce_add_optimised(engine, buffer_Temp_sd, vector_elements, Kernel_time, Total_mem_time, Overall_time, sampleSize);
+        return;
+    }
 
-    std::vector<float> Mean_sd = { Mean };
-    size_t mean_size_sd = Mean_sd.size() * sizeof(float);
+    // Step 1
+    // the temperatures are already on the device. sd_map only writes the first vector_elements outputs, so the padded...
+    // ...tail of the global range never reaches the sum
+    size_t global_elements = (vector_elements + workgroupSize - 1) / workgroupSize * workgroupSize;
+    size_t output_size_sd = vector_elements * sizeof(float);
 
-    cl::Buffer buffer_Temp_sd(context, CL_MEM_READ_WRITE, vector_size);
     cl::Buffer buffer_Out_sd(context, CL_MEM_READ_WRITE, output_size_sd);
-    cl::Buffer buffer_Mean_sd(context, CL_MEM_READ_WRITE, mean_size_sd);
-
-    cl::Event write_event;
-    cl::Event write_event_2;
-
-    // copy to device memory
-    queue.enqueueWriteBuffer(buffer_Temp_sd, CL_TRUE, 0, vector_size, &Temperatures_sd[0], NULL, &write_event);
-    queue.enqueueWriteBuffer(buffer_Mean_sd, CL_TRUE, 0, mean_size_sd, &Mean_sd[0], NULL, &write_event_2);
-    queue.enqueueFillBuffer(buffer_Out_sd, 0, 0, output_size_sd);
 
-    // setup kenerl
+    // setup kenerl - the mean is passed by value, no buffer and no upload for a single float
     cl::Kernel kernel_sd = cl::Kernel(program, "sd_map");
     kernel_sd.setArg(0, buffer_Temp_sd);
-    kernel_sd.setArg(1, buffer_Out_sd);
-    kernel_sd.setArg(2, buffer_Mean_sd);
-    kernel_sd.setArg(3, cl::Local(workgroupSize * sizeof(float)));//local memory size
+    kernel_sd.setArg(1, (int)vector_elements);
+    kernel_sd.setArg(2, buffer_Out_sd);
+    kernel_sd.setArg(3, Mean);
 
     cl::Event kernel_event;
 
     // execute kernel
-    queue.enqueueNDRangeKernel(kernel_sd, cl::NullRange, cl::NDRange(vector_elements), cl::NDRange(workgroupSize), NULL, &kernel_event);
+    queue.enqueueNDRangeKernel(kernel_sd, cl::NullRange, cl::NDRange(global_elements), cl::NDRange(workgroupSize), NULL, &kernel_event);
+    kernel_event.wait();
 
-    cl::Event read_event;
+    int Current_Kernel_Time = kernel_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - kernel_event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+    Kernel_time += Current_Kernel_Time;
+    Overall_time += Current_Kernel_Time;
 
-    // Read output of kernel
+    //each item's (item - mean)^2 has been calculated. Combine these values with reduce pattern
+    //...the non-optimised version reads the whole map output back and uploads it again for every reduction pass
+    std::vector<float> Output_sd(vector_elements, 0);
+
+    cl::Event read_event;
     queue.enqueueReadBuffer(buffer_Out_sd, CL_TRUE, 0, output_size_sd, &Output_sd[0], NULL, &read_event);
 
-    int write_time = write_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - write_event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
-    int write_time_2 = write_event_2.getProfilingInfo<CL_PROFILING_COMMAND_END>() - write_event_2.getProfilingInfo<CL_PROFILING_COMMAND_START>();
     int read_time = read_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - read_event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+    Total_mem_time += read_time;
+    Overall_time += read_time;
 
-    int Current_Kernel_Time = kernel_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - kernel_event.getProfilingInfo<CL_PROFILING_COMMAND_START>();;
-    int Current_mem_time = write_time + write_time_2 + read_time;
-
-    Kernel_time += kernel_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - kernel_event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
-    Total_mem_time += write_time + read_time + write_time_2;
-    Overall_time += Current_mem_time + Current_Kernel_Time;
-
-    //remove padded values so they not included in the reduce addition sum - prevents skewed result
-    int sizeDiff = vector_elements - vector_elements_before_padding;
-    Output_sd.resize(vector_elements - sizeDiff);
-
-    //each workgroups sum of (item - mean)^2 has been calculated. Combine these sums with reduce pattern
-    if (optimised) {
-        reduce_add_optimised(Output_sd, context, program, workgroupSize, queue, Kernel_time, Total_mem_time, Overall_time, 0, sampleSize);
-    }
-    else {
-        reduce_add_non_optimised(Output_sd, context, program, workgroupSize, queue, Kernel_time, Total_mem_time, Overall_time, 0, sampleSize);
-    }
+    reduce_add_non_optimised(engine, Output_sd, Kernel_time, Total_mem_time, Overall_time, sampleSize);
 }
 
-void bitonic(std::vector<float> Temperatures_unpadded, cl::Context context, cl::Program program, size_t workgroupSize, cl::CommandQueue queue) {
-    //This method attempts to sort the array using 'bitonic sort'. The sorted aray would have been used for median etc
-    //Unfortunatley I could only get the sort working for smaller arrays (length <= 512) and therefore I could not
-    //run this method successfully.
-    
-    // pad the array to have length equal to a multiple of 32 AND a power of 2 (bitonic only works with a power of 2)
-    vector<float> Temperatures = padding(Temperatures_unpadded, 0, 1000, true); 
-    size_t vector_elements = Temperatures.size();//number of elements
-    size_t vector_size = Temperatures.size() * sizeof(float);
+float sorted_quantile(cl::CommandQueue queue, cl::Buffer& buffer_Sorted, size_t vector_elements, double q, int& Total_mem_time, int& Overall_time) {
+    //q-th quantile of sorted values, interpolating linearly between the two nearest ranks. Only those two values are read back
+    double rank = q * (vector_elements - 1);
+    size_t lower = (size_t)rank;
+    size_t pair = min((size_t)2, vector_elements - lower);
+    float values[2];
 
-    std::vector<float> Output_bitonic(vector_elements, 0);
-    size_t output_size_bitonic = Output_bitonic.size() * sizeof(float);
+    cl::Event read_event;
+    queue.enqueueReadBuffer(buffer_Sorted, CL_TRUE, lower * sizeof(float), pair * sizeof(float), values, NULL, &read_event);
+    int read_time = read_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - read_event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+    Total_mem_time += read_time;
+    Overall_time += read_time;
 
-    // Buffers
-    cl::Buffer buffer_Temp(context, CL_MEM_READ_WRITE, vector_size);
-    cl::Buffer buffer_Out_bitonic(context, CL_MEM_READ_WRITE, output_size_bitonic);
+    if (pair == 1)
+        return values[0];
+    return (float)(values[0] + (rank - lower) * (values[1] - values[0]));
+}
 
-    cl::Event write_event;
+void median(WeatherStatsEngine& engine, cl::Buffer& buffer_Temp, size_t vector_elements, int& Kernel_time, int& Total_mem_time, int& Overall_time) {
+    //The median and quartiles come from a sorted copy of the data. engine.sort is a bitonic sort split over several launches
+    //...(a barrier can't synchronise the whole array, so the old single launch only worked up to one work-group), so any size works.
+    //The sorted copy stays on the device and only the values either side of each quantile are read back
+    cout << "\n******MEDIAN AND QUARTILES******" << endl;
+    if (!vector_elements)
+        return;
+    cl::Buffer buffer_Sorted = engine.sort(buffer_Temp, vector_elements, Kernel_time, Total_mem_time, Overall_time);
+
+    float lower_quartile = sorted_quantile(engine.queue(), buffer_Sorted, vector_elements, 0.25, Total_mem_time, Overall_time);
+    float medianVal = sorted_quantile(engine.queue(), buffer_Sorted, vector_elements, 0.5, Total_mem_time, Overall_time);
+    float upper_quartile = sorted_quantile(engine.queue(), buffer_Sorted, vector_elements, 0.75, Total_mem_time, Overall_time);
+    engine.buffers().release(buffer_Sorted);
+
+    cout << "Calculated Median = " << medianVal << endl;
+    cout << "Calculated 1st Quartile = " << lower_quartile << endl;
+    cout << "Calculated 3rd Quartile = " << upper_quartile << endl;
+    cout << "Calculated IQR = " << upper_quartile - lower_quartile << endl;
+
+    std::cout << "\nKernel execution time [ns]: " << Kernel_time << std::endl;
+    std::cout << "Total memory transfer time [ns]: " << Total_mem_time << std::endl;
+    std::cout << "Overall Opetation Time [ns]: " << Overall_time << std::endl;
+}
 
-    cout << "Input Size: " << Temperatures.size() << endl; //double check input size
-    // copy to device memory
-    queue.enqueueWriteBuffer(buffer_Temp, CL_TRUE, 0, vector_size, &Temperatures[0], NULL, &write_event);
-    queue.enqueueFillBuffer(buffer_Out_bitonic, 0, 0, output_size_bitonic);
+void median_histogram(WeatherStatsEngine& engine, cl::Buffer& buffer_Temp, size_t vector_elements, float minVal, float maxVal,
+    int& Kernel_time, int& Total_mem_time, int& Overall_time) {
+    //Exact median, quartiles, IQR and mode without sorting. The temperatures are whole tenths of a degree, so a histogram with one
+    //...bin per tenth between the min and the max (histogram_tenths, one pass over the data) holds everything needed and the
+    //...host walks its ~1000 bins. Gives the same quantiles as the sort
+    cout << "\n******MEDIAN, QUARTILES AND MODE (HISTOGRAM)******" << endl;
+    TemperatureHistogram histogram = engine.histogram(buffer_Temp, vector_elements, minVal, maxVal, Kernel_time, Total_mem_time, Overall_time);
+    if (!histogram.total)
+        return;
+
+    cout << "Calculated Median = " << histogram.median() << endl;
+    cout << "Calculated 1st Quartile = " << histogram.quantile(0.25) << endl;
+    cout << "Calculated 3rd Quartile = " << histogram.quantile(0.75) << endl;
+    cout << "Calculated IQR = " << histogram.iqr() << endl;
+    cout << "Calculated 5th / 95th Percentile = " << histogram.quantile(0.05) << " / " << histogram.quantile(0.95) << endl;
+    cout << "Calculated Mode = " << histogram.mode() << endl;
+
+    std::cout << "\nKernel execution time [ns]: " << Kernel_time << std::endl;
+    std::cout << "Total memory transfer time [ns]: " << Total_mem_time << std::endl;
+    std::cout << "Overall Opetation Time [ns]: " << Overall_time << std::endl;
+}
 
-    // setup kenerl
-    cl::Kernel kernel_bitonic = cl::Kernel(program, "sort_bitonic");
-    kernel_bitonic.setArg(0, buffer_Temp);
-    kernel_bitonic.setArg(1, buffer_Out_bitonic);
-    //kernel_bitonic.setArg(2, cl::Local(workgroupSize * sizeof(float)));//local memory size
+void median_deviation(WeatherStatsEngine& engine, cl::Buffer& buffer_Temp, size_t vector_elements, float Mean,
+    int& Kernel_time, int& Total_mem_time, int& Overall_time) {
+    //Median absolute deviation from the mean. The deviations aren't tenths of a degree any more, so there is no histogram to walk;
+    //...engine.quantile radix-selects the median straight from the sd_map output on the device, no sort and no read back of the column
+    cout << "\n******MEDIAN DEVIATION FROM THE MEAN (RADIX SELECT)******" << endl;
+    if (!vector_elements)
+        return;
+    size_t workgroupSize = engine.workgroupSize();
+    size_t global_elements = (vector_elements + workgroupSize - 1) / workgroupSize * workgroupSize;
+    cl::Buffer buffer_Squares = engine.buffers().acquire(vector_elements * sizeof(float));
+
+    cl::Kernel& kernel_sd = engine.kernel("sd_map");
+    kernel_sd.setArg(0, buffer_Temp);
+    kernel_sd.setArg(1, (int)vector_elements);
+    kernel_sd.setArg(2, buffer_Squares);
+    kernel_sd.setArg(3, Mean);
 
     cl::Event kernel_event;
+    engine.queue().enqueueNDRangeKernel(kernel_sd, cl::NullRange, cl::NDRange(global_elements), cl::NDRange(workgroupSize), NULL, &kernel_event);
+    kernel_event.wait();
+    int map_time = kernel_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - kernel_event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+    Kernel_time += map_time;
+    Overall_time += map_time;
 
-    // execute kernel
-    queue.enqueueNDRangeKernel(kernel_bitonic, cl::NullRange, cl::NDRange(vector_elements), cl::NullRange, NULL, &kernel_event);
-
-    cl::Event read_event;
-
-    queue.enqueueReadBuffer(buffer_Out_bitonic, CL_TRUE, 0, output_size_bitonic, &Output_bitonic[0], NULL, &read_event);
-
-    //cout << "\nUn-Sorted list: " << Temperatures << endl;
-    std::cout << "Sorted list: " << Output_bitonic << endl;
+    //the square root is monotonic, so the median of the squared deviations is the squared median deviation
+    float median_square = engine.quantile(buffer_Squares, vector_elements, 0.5, Kernel_time, Total_mem_time, Overall_time);
+    engine.buffers().release(buffer_Squares);
 
-    //Calculate performance of kernel 
-    int Kernel_time = kernel_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - kernel_event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
-
-    int write_time = write_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - write_event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
-    int read_time = read_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - read_event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
-    int Total_mem_time = write_time + read_time;
+    cout << "Calculated Median Absolute Deviation = " << sqrt(median_square) << endl;
 
-    std::cout << "\n\nKernel execution time [ns]: " << Kernel_time << std::endl;
+    std::cout << "\nKernel execution time [ns]: " << Kernel_time << std::endl;
     std::cout << "Total memory transfer time [ns]: " << Total_mem_time << std::endl;
-    std::cout << "Overall Opetation Time [ns]: " << Total_mem_time + Kernel_time << std::endl;
+    std::cout << "Overall Opetation Time [ns]: " << Overall_time << std::endl;
+}
 
-    std::cout << GetFullProfilingInfo(kernel_event, ProfilingResolution::PROF_US) << std::endl;
+void benchmark_reductions(WeatherStatsEngine& engine, int runs = 10) {
+    //Times one pass of each work-group reduction variant over the resident dataset: the old interleaved loop (the
+    //..._interleaved kernels), the sequential-addressing local memory tree, and the work-group or sub-group built-ins
+    //...when the engine is using them. Each kernel gets a warm up launch and is then averaged over 'runs'.
+    //Run once with the short and once with the full dataset (--dataset) to compare both sizes
+    DeviceDataset& dataset = engine.dataset();
+    cl::CommandQueue queue = engine.queue();
+    size_t workgroupSize = engine.workgroupSize();
+    size_t vector_elements = dataset.size();
+    if (!vector_elements)
+        return;
+    size_t groups = (vector_elements + workgroupSize - 1) / workgroupSize;
+    cl::Buffer buffer_Out = engine.buffers().acquire(groups * sizeof(float));
+
+    auto time_kernel = [&](cl::Kernel kernel) {
+        kernel.setArg(0, dataset.temperatures());
+        kernel.setArg(1, (int)vector_elements);
+        kernel.setArg(2, buffer_Out);
+        kernel.setArg(3, cl::Local(workgroupSize * sizeof(float)));
+        double Kernel_time = 0;
+        for (int r = 0; r <= runs; r++) {
+            cl::Event kernel_event;
+            queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(groups * workgroupSize), cl::NDRange(workgroupSize), NULL, &kernel_event);
+            kernel_event.wait();
+            if (r) //the first launch is a warm up
+                Kernel_time += (double)(kernel_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - kernel_event.getProfilingInfo<CL_PROFILING_COMMAND_START>()) / runs;
+        }
+        return Kernel_time;
+    };
+
+    //the engine's program uses its best path, so the tree needs a build of its own when that isn't the tree
+    ReducePath path = engine.reducePath();
+    cl::Program tree_program = (path == REDUCE_TREE) ? engine.program() : engine.buildProgram(REDUCE_TREE);
+
+    cout << "\n******REDUCTION KERNELS (" << vector_elements << " values, work-group size " << workgroupSize << ")******" << endl;
+    cout << "Reduction path in use: " << reducePathName(path) << endl;
+    const char* kernel_names[] = { "min_reduce", "reduce" };
+    for (const char* name : kernel_names) {
+        double Kernel_time_interleaved = time_kernel(engine.kernel(string(name) + "_interleaved"));
+        double Kernel_time_tree = time_kernel(cl::Kernel(tree_program, name));
+        printf("%-12s interleaved        %12.0f ns\n", name, Kernel_time_interleaved);
+        printf("%-12s %-18s %12.0f ns (%.2fx)\n", name, reducePathName(REDUCE_TREE), Kernel_time_tree, Kernel_time_interleaved / max(Kernel_time_tree, 1.0));
+        if (path != REDUCE_TREE) {
+            double Kernel_time_builtin = time_kernel(engine.kernel(name));
+            printf("%-12s %-18s %12.0f ns (%.2fx)\n", name, reducePathName(path), Kernel_time_builtin, Kernel_time_interleaved / max(Kernel_time_builtin, 1.0));
+        }
+    }
+    engine.buffers().release(buffer_Out);
 }
 
-void execute_optimised_program(std::vector<float> Temperatures_unpadded, cl::Context context, cl::Program program,
-    size_t workgroupSize, cl::CommandQueue queue, int& Total_Kernel_time, int& Total_mem_time, int& Total_program_time) {
+void execute_optimised_program(WeatherStatsEngine& engine, int& Total_Kernel_time, int& Total_mem_time, int& Total_program_time, bool fused = true,
+    bool sort_median = false) {
+    DeviceDataset& dataset = engine.dataset();
+    cl::Context context = engine.context();
+    cl::Program program = engine.program();
+    cl::CommandQueue queue = engine.queue();
+
+    //every statistic reads the dataset that was uploaded once in main, so its upload is the only large transfer of the run
+    std::cout << "\nDataset upload, once for all statistics (" << dataset.bytes() << " bytes) [ns]: " << dataset.uploadTime() << std::endl;
+
+    //By default all four statistics come out of the single fused kernel. 'fused = false' runs the separate
+    //...mean / min / max / SD kernels below instead (--separate-kernels).
+    //The median comes from a histogram of the data, or from a full sort with 'sort_median' (--sort-median)
+    if (fused) {
+        cout << "\n******MEAN, MINIMUM, MAXIMUM, STANDARD DEVIATION (FUSED)******" << endl;
+        WeatherStats stats = engine.compute(STAT_ALL);
+        int Kernel_time_fused = stats.kernel_time;
+        int Total_mem_time_fused = stats.transfer_time;
+        int Overall_time_fused = stats.kernel_time + stats.transfer_time;
+
+        cout << "Calculated Mean: ";
+        printf("%.1f\n", stats.mean);
+        cout << "Calculated Min = " << stats.min << endl;
+        cout << "Calculated Max = " << stats.max << endl;
+        cout << "Calculated SD = ";
+        printf("%.1f\n", stats.sd);
+
+        std::cout << "\nKernel execution time [ns]: " << Kernel_time_fused << std::endl;
+        std::cout << "Total memory transfer time [ns]: " << Total_mem_time_fused << std::endl;
+        std::cout << "Overall Opetation Time [ns]: " << Overall_time_fused << std::endl;
+
+        Total_Kernel_time = Kernel_time_fused;
+        Total_mem_time = dataset.uploadTime() + Total_mem_time_fused;
+        Total_program_time = dataset.uploadTime() + Overall_time_fused;
+
+        //the non-optimised program has no median, so its time is reported on its own and left out of the totals
+        int Kernel_time_median = 0;
+        int Total_mem_time_median = 0;
+        int Overall_time_median = 0;
+        if (sort_median)
+            median(engine, dataset.temperatures(), dataset.size(), Kernel_time_median, Total_mem_time_median, Overall_time_median);
+        else
+            median_histogram(engine, dataset.temperatures(), dataset.size(), stats.min, stats.max, Kernel_time_median, Total_mem_time_median, Overall_time_median);
+
+        int Kernel_time_deviation = 0;
+        int Total_mem_time_deviation = 0;
+        int Overall_time_deviation = 0;
+        median_deviation(engine, dataset.temperatures(), dataset.size(), stats.mean, Kernel_time_deviation, Total_mem_time_deviation, Overall_time_deviation);
+        return;
+    }
+
     //**********MEAN**********  
     float meanVal = 0;
     int Kernel_time_mean = 0;
     int Total_mem_time_mean = 0;
     int Overall_time_mean = 0;
-    mean(Temperatures_unpadded, context, program, workgroupSize, queue, meanVal, Kernel_time_mean, Total_mem_time_mean, Overall_time_mean, true);
+    mean(engine, dataset.temperatures(), dataset.size(), meanVal, Kernel_time_mean, Total_mem_time_mean, Overall_time_mean, true);
 
     //***********MINIMUM**********      
     cout << "\n******MINIMUM******" << endl;
 
-    //call the min_reduce function multiple times to perform multi-pass reduction     
+    //min_reduce_vec covers the whole dataset in one grid-stride pass, the driver only adds a pass for very large devices
     int Kernel_time_min = 0;
     int Total_mem_time_min = 0;
     int Overall_time_min = 0;
-    minimum(Temperatures_unpadded, context, program, workgroupSize, queue, Kernel_time_min, Total_mem_time_min, Overall_time_min, 0);
+    float minVal = minimum(engine, dataset.temperatures(), dataset.size(), Kernel_time_min, Total_mem_time_min, Overall_time_min, true);
 
     std::cout << "\nKernel execution time [ns]: " << Kernel_time_min << std::endl;
     std::cout << "Total memory transfer time [ns]: " << Total_mem_time_min << std::endl;
@@ -540,8 +652,7 @@ void execute_optimised_program(std::vector<float> Temperatures_unpadded, cl::Con
     int Kernel_time_max = 0;
     int Total_mem_time_max = 0;
     int Overall_time_max = 0;
-    //cout << "Actual Max = " << *std::max_element(std::begin(Temperatures_unpadded), std::end(Temperatures_unpadded)) << endl;
-    maximum(Temperatures_unpadded, context, program, workgroupSize, queue, Kernel_time_max, Total_mem_time_max, Overall_time_max, 0);
+    float maxVal = maximum(engine, dataset.temperatures(), dataset.size(), Kernel_time_max, Total_mem_time_max, Overall_time_max, true);
 
     std::cout << "\nKernel execution time [ns]: " << Kernel_time_max << std::endl;
     std::cout << "Total memory transfer time [ns]: " << Total_mem_time_max << std::endl;
@@ -554,9 +665,9 @@ void execute_optimised_program(std::vector<float> Temperatures_unpadded, cl::Con
     int Kernel_time_sd = 0;
     int Total_mem_time_sd = 0;
     int Overall_time_sd = 0;
-    int sampleSize = Temperatures_unpadded.size();
+    int sampleSize = dataset.size();
 
-    sd(Temperatures_unpadded, context, program, workgroupSize, queue, Kernel_time_sd, Total_mem_time_sd, Overall_time_sd, meanVal, sampleSize, true);
+    sd(engine, dataset.temperatures(), dataset.size(), Kernel_time_sd, Total_mem_time_sd, Overall_time_sd, meanVal, sampleSize, true);
 
     //int Kernel_time_sd_atomic = 0;
     //int Total_mem_time_sd_atomic = 0;
@@ -571,28 +682,327 @@ void execute_optimised_program(std::vector<float> Temperatures_unpadded, cl::Con
     //std::cout << "Total memory transfer time atomic [ns]: " << Total_mem_time_sd_atomic << std::endl;
     //std::cout << "Overall Opetation Time atomic [ns]: " << Overall_time_sd_atomic << std::endl;
 
-    //**Bitonic test**
-    //cout << "\n******BITONIC SORT******" << endl;
-    //bitonic(Temperatures_unpadded, context, program, workgroupSize, queue, 0);
+    //**Median**
+    //the non-optimised program has no median, so its time is reported on its own and left out of the totals
+    int Kernel_time_median = 0;
+    int Total_mem_time_median = 0;
+    int Overall_time_median = 0;
+    if (sort_median)
+        median(engine, dataset.temperatures(), dataset.size(), Kernel_time_median, Total_mem_time_median, Overall_time_median);
+    else
+        median_histogram(engine, dataset.temperatures(), dataset.size(), minVal, maxVal, Kernel_time_median, Total_mem_time_median, Overall_time_median);
+
+    int Kernel_time_deviation = 0;
+    int Total_mem_time_deviation = 0;
+    int Overall_time_deviation = 0;
+    median_deviation(engine, dataset.temperatures(), dataset.size(), meanVal, Kernel_time_deviation, Total_mem_time_deviation, Overall_time_deviation);
 
     //**Total Performance Metrics**
     Total_Kernel_time = Kernel_time_min + Kernel_time_max + Kernel_time_sd + Kernel_time_mean;
-    Total_mem_time = Total_mem_time_min + Total_mem_time_max + Total_mem_time_sd + Total_mem_time_mean;
-    Total_program_time = Overall_time_min + Overall_time_max + Overall_time_sd + Overall_time_mean;
+    Total_mem_time = dataset.uploadTime() + Total_mem_time_min + Total_mem_time_max + Total_mem_time_sd + Total_mem_time_mean;
+    Total_program_time = dataset.uploadTime() + Overall_time_min + Overall_time_max + Overall_time_sd + Overall_time_mean;
+}
+
+
+void execute_async_program(WeatherStatsEngine& engine, int& Total_Kernel_time, int& Total_mem_time, int& Total_program_time, size_t lanes = 1) {
+    //The separate-kernels statistics submitted as one CommandGraph, every enqueue non-blocking and ordered only by what it needs:
+    //   mean: zero -> reduce_fixed -> read sum
+    //   SD:   zero -> sumsq_fixed -> read sum of squares (the SD comes from both sums, so it doesn't wait for the mean)
+    //   min:  min_reduce_vec -> read partials
+    //   max:  max_reduce_vec -> read partials
+    //The host blocks once, when every result is back, then finishes the partials. All the reads are queued after all the
+    //...kernels so no read holds up a kernel behind it.
+    //With 'lanes' > 1 (--queues) the three chains have no reason to wait for each other, so mean/SD, min and max each get
+    //...a lane of engine.concurrentQueues - their own in-order queue, or all of them one out-of-order queue - and the
+    //...device is free to run them at the same time. The overlap it achieved is measured from the event timestamps
+    cout << "\n******MEAN, MINIMUM, MAXIMUM AND SD (ASYNC COMMAND GRAPH)******" << endl;
+    DeviceDataset& dataset = engine.dataset();
+    size_t vector_elements = dataset.size();
+    if (!vector_elements)
+        return;
+    size_t workgroupSize = engine.workgroupSize();
+    BufferPool& buffers = engine.buffers();
+
+    bool atomics = built_with_int64_atomics(engine.context(), engine.program());
+    size_t sum_groups = engine.stridedGroups(vector_elements, 1, "reduce_fixed");
+    size_t sum_slots = atomics ? 1 : sum_groups;
+    size_t min_groups = engine.stridedGroups(vector_elements, 4, "min_reduce_vec");
+    size_t max_groups = engine.stridedGroups(vector_elements, 4, "max_reduce_vec");
+
+    cl::Buffer buffer_Sum = buffers.acquire(sum_slots * sizeof(cl_long));
+    cl::Buffer buffer_SumSq = buffers.acquire(sum_slots * sizeof(cl_long));
+    cl::Buffer buffer_Min = buffers.acquire(min_groups * sizeof(float));
+    cl::Buffer buffer_Max = buffers.acquire(max_groups * sizeof(float));
+    std::vector<cl_long> Sum(sum_slots), SumSq(sum_slots);
+    std::vector<float> Min(min_groups), Max(max_groups);
+
+    cl::Kernel& kernel_mean = engine.kernel("reduce_fixed");
+    kernel_mean.setArg(0, dataset.temperatures());
+    kernel_mean.setArg(1, (cl_ulong)vector_elements);
+    kernel_mean.setArg(2, 10.0f);
+    kernel_mean.setArg(3, buffer_Sum);
+    kernel_mean.setArg(4, cl::Local(workgroupSize * sizeof(cl_long)));
+
+    cl::Kernel& kernel_sd = engine.kernel("sumsq_fixed");
+    kernel_sd.setArg(0, dataset.temperatures());
+    kernel_sd.setArg(1, (cl_ulong)vector_elements);
+    kernel_sd.setArg(2, 10.0f);
+    kernel_sd.setArg(3, buffer_SumSq);
+    kernel_sd.setArg(4, cl::Local(workgroupSize * sizeof(cl_long)));
+
+    cl::Kernel& kernel_min = engine.kernel("min_reduce_vec");
+    kernel_min.setArg(0, dataset.temperatures());
+    kernel_min.setArg(1, (cl_ulong)vector_elements);
+    kernel_min.setArg(2, buffer_Min);
+    kernel_min.setArg(3, cl::Local(workgroupSize * sizeof(float)));
+
+    cl::Kernel& kernel_max = engine.kernel("max_reduce_vec");
+    kernel_max.setArg(0, dataset.temperatures());
+    kernel_max.setArg(1, (cl_ulong)vector_elements);
+    kernel_max.setArg(2, buffer_Max);
+    kernel_max.setArg(3, cl::Local(workgroupSize * sizeof(float)));
+
+    std::vector<cl::CommandQueue> queues(1, engine.queue());
+    if (lanes > 1) {
+        queues = engine.concurrentQueues(lanes);
+        if (queues.size() == 1)
+            cout << "Running on one out-of-order queue" << endl;
+        else
+            cout << "Running on " << queues.size() << " in-order queues" << endl;
+    }
+
+    auto start = chrono::high_resolution_clock::now();
+    CommandGraph graph(queues);
+    CommandGraph::Node sum_zero = graph.fill("zero mean sum", buffer_Sum, (cl_long)0, sum_slots * sizeof(cl_long));
+    CommandGraph::Node sq_zero = graph.fill("zero SD sum", buffer_SumSq, (cl_long)0, sum_slots * sizeof(cl_long));
+    CommandGraph::Node mean_node = graph.kernel("reduce_fixed", kernel_mean, cl::NDRange(sum_groups * workgroupSize), cl::NDRange(workgroupSize), { sum_zero });
+    CommandGraph::Node sd_node = graph.kernel("sumsq_fixed", kernel_sd, cl::NDRange(sum_groups * workgroupSize), cl::NDRange(workgroupSize), { sq_zero });
+    graph.lane(1);
+    CommandGraph::Node min_node = graph.kernel("min_reduce_vec", kernel_min, cl::NDRange(min_groups * workgroupSize), cl::NDRange(workgroupSize));
+    graph.lane(2);
+    CommandGraph::Node max_node = graph.kernel("max_reduce_vec", kernel_max, cl::NDRange(max_groups * workgroupSize), cl::NDRange(workgroupSize));
+    graph.lane(0);
+    graph.read("read mean sum", buffer_Sum, sum_slots * sizeof(cl_long), &Sum[0], { mean_node });
+    graph.read("read SD sum", buffer_SumSq, sum_slots * sizeof(cl_long), &SumSq[0], { sd_node });
+    graph.lane(1);
+    graph.read("read min partials", buffer_Min, min_groups * sizeof(float), &Min[0], { min_node });
+    graph.lane(2);
+    graph.read("read max partials", buffer_Max, max_groups * sizeof(float), &Max[0], { max_node });
+    graph.wait();
+
+    long long sum = 0, sumSq = 0;
+    for (cl_long partial : Sum)
+        sum += partial;
+    for (cl_long partial : SumSq)
+        sumSq += partial;
+    float meanVal = (float)((double)sum / 10 / vector_elements);
+    float minVal = *std::min_element(Min.begin(), Min.end());
+    float maxVal = *std::max_element(Max.begin(), Max.end());
+    float sdVal = (float)sqrt(max(0.0, fixed_squared_deviations(sum, sumSq, vector_elements)) / 100 / vector_elements);
+    auto wall_time = chrono::duration_cast<chrono::nanoseconds>(chrono::high_resolution_clock::now() - start).count();
+
+    buffers.release(buffer_Sum);
+    buffers.release(buffer_SumSq);
+    buffers.release(buffer_Min);
+    buffers.release(buffer_Max);
+
+    cout << "Calculated Mean = " << meanVal << endl;
+    cout << "Calculated Min = " << minVal << endl;
+    cout << "Calculated Max = " << maxVal << endl;
+    cout << "Calculated SD = ";
+    printf("%.1f\n", sdVal);
+
+    cout << "\nCommand graph nodes:" << endl;
+    graph.report(cout);
+    std::cout << "\nKernel execution time [ns]: " << graph.kernelTime() << std::endl;
+    std::cout << "Total memory transfer time [ns]: " << graph.memTime() << std::endl;
+    std::cout << "Device time, first command to last [ns]: " << graph.span() << std::endl;
+    std::cout << "Host time, first enqueue to results [ns]: " << wall_time << std::endl;
+
+    //overlap: how long two or more commands were running at once, and the commands' total time over the time the
+    //...device was busy with any of them (1.0 = strictly one after another)
+    int busy = graph.busy();
+    std::cout << "Overlapped time [ns]: " << graph.overlapped() << " of " << busy << " busy" << std::endl;
+    std::cout << "Concurrency: " << (busy ? (double)(graph.kernelTime() + graph.memTime()) / busy : 1.0) << "x" << std::endl;
+
+    Total_Kernel_time = graph.kernelTime();
+    Total_mem_time = dataset.uploadTime() + graph.memTime();
+    Total_program_time = dataset.uploadTime() + graph.span();
+}
+void execute_multi_device_program(const float* Temperatures, size_t count, size_t workgroupSize, unsigned int cpu_split) {
+    //Mean, min, max and SD with the dataset split over every usable device (MultiDevice.h). Each device gets a slice in
+    //...proportion to its measured throughput, runs moments_fused on it, and the host merges the slices' partial moments
+    cout << "\n--------------------------------------Executing Multi-Device Program--------------------------------------" << endl;
+    auto start = chrono::high_resolution_clock::now();
+    std::vector<DeviceShare> shares = createDeviceShares("kernels/kernels.cl", workgroupSize, cpu_split);
+    auto setup_time = chrono::duration_cast<chrono::milliseconds>(chrono::high_resolution_clock::now() - start).count();
+
+    start = chrono::high_resolution_clock::now();
+    Moments moments = computeAcrossDevices(shares, Temperatures, count);
+    auto run_time = chrono::duration_cast<chrono::milliseconds>(chrono::high_resolution_clock::now() - start).count();
+
+    for (const DeviceShare& share : shares) {
+        cout << share.name << " (work-group size " << share.engine->workgroupSize() << "): " << share.throughput << " values/ns measured, "
+            << share.count << " values (" << (count ? 100.0 * share.count / count : 0.0) << "%)"
+            << " | kernel [ns]: " << share.stats.kernel_time << ", upload [ns]: " << (share.count ? share.engine->dataset().uploadTime() : 0)
+            << ", wall [ms]: " << share.time << endl;
+    }
+
+    cout << "\nCalculated Mean = " << moments.mean << endl;
+    cout << "Calculated Min = " << moments.min << endl;
+    cout << "Calculated Max = " << moments.max << endl;
+    cout << "Calculated SD = ";
+    printf("%.1f\n", moments.sd());
+    cout << "\nDevices: " << shares.size() << ", setup [ms]: " << setup_time << ", calibrate + split + merge [ms]: " << run_time << endl;
+}
+
+//Fixed-point methods
+template <typename T>
+vector<T> reduce_dc_groups(WeatherStatsEngine& engine, cl::Buffer& buffer_Temp, size_t vector_elements, const char* kernel_name,
+    int& Kernel_time, int& Total_mem_time, int& Overall_time) {
+    //runs one of the vectorised int16 reduction kernels over the device copy of the tenths and returns one (widened) result
+    //...per work-group. The kernels load 8 values at a time in a grid-stride loop, so the launch is sized from the device's
+    //...compute units (a few hundred groups at most) and the host finishes the partials
+    cl::CommandQueue queue = engine.queue();
+    size_t workgroupSize = engine.workgroupSize();
+    size_t groups = engine.stridedGroups(vector_elements, 8, kernel_name);
+
+    std::vector<T> Output(groups);
+    size_t output_size = Output.size() * sizeof(T);
+
+    cl::Buffer buffer_Out = engine.buffers().acquire(output_size);
+
+    // setup kenerl
+    cl::Kernel& kernel = engine.kernel(kernel_name);
+    kernel.setArg(0, buffer_Temp);
+    kernel.setArg(1, (cl_ulong)vector_elements);
+    kernel.setArg(2, buffer_Out);
+    kernel.setArg(3, cl::Local(workgroupSize * sizeof(T)));//local memory size
+
+    cl::Event kernel_event;
+
+    // execute kernel
+    queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(groups * workgroupSize), cl::NDRange(workgroupSize), NULL, &kernel_event);
+
+    cl::Event read_event;
+
+    // Read output of kernel
+    queue.enqueueReadBuffer(buffer_Out, CL_TRUE, 0, output_size, &Output[0], NULL, &read_event);
+    engine.buffers().release(buffer_Out);
+
+    int read_time = read_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - read_event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+    int Current_Kernel_Time = kernel_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - kernel_event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+
+    Kernel_time += Current_Kernel_Time;
+    Total_mem_time += read_time;
+    Overall_time += Current_Kernel_Time + read_time;
+
+    return Output;
+}
+
+void execute_fixed_point_program(WeatherStatsEngine& engine, const Column<int16_t>& Tenths, int& Total_Kernel_time, int& Total_mem_time, int& Total_program_time) {
+    //Same statistics as execute_optimised_program but on the int16 tenths-of-a-degree column. Uploads half the bytes
+    //...of the float path and every sum is an exact integer (long per work-group, summed in 64 bits on the host)
+    size_t vector_elements = Tenths.size();
+    if (!vector_elements) {
+        cout << "\nNo records, nothing to compute" << endl;
+        return;
+    }
+    size_t vector_size = Tenths.size() * sizeof(int16_t);
+    cl::CommandQueue queue = engine.queue();
+
+    cl::Buffer buffer_Temp = engine.buffers().acquire(vector_size);
+
+    cl::Event write_event;
+
+    // copy to device memory - once, every statistic below reads the same buffer
+    queue.enqueueWriteBuffer(buffer_Temp, CL_TRUE, 0, vector_size, &Tenths[0], NULL, &write_event);
+    int write_time = write_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - write_event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+    std::cout << "\nUpload of " << vector_size << " bytes [ns]: " << write_time << std::endl;
+
+    //**********MEAN**********
+    cout << "\n******MEAN******" << endl;
+    int Kernel_time_mean = 0;
+    int Total_mem_time_mean = 0;
+    int Overall_time_mean = 0;
+    vector<cl_long> sums = reduce_dc_groups<cl_long>(engine, buffer_Temp, vector_elements, "reduce_dc_vec",
+        Kernel_time_mean, Total_mem_time_mean, Overall_time_mean);
+    long long sum = 0;
+    for (cl_long group_sum : sums)
+        sum += group_sum;
+    double meanVal = (double)sum / vector_elements / 10;
+
+    cout << "Calculated Mean: ";
+    printf("%.1f\n", meanVal);
+    std::cout << "\nKernel execution time [ns]: " << Kernel_time_mean << std::endl;
+    std::cout << "Total memory transfer time [ns]: " << Total_mem_time_mean << std::endl;
+    std::cout << "Overall Opetation Time [ns]: " << Overall_time_mean << std::endl;
+
+    //***********MINIMUM**********
+    cout << "\n******MINIMUM******" << endl;
+    int Kernel_time_min = 0;
+    int Total_mem_time_min = 0;
+    int Overall_time_min = 0;
+    vector<cl_short> mins = reduce_dc_groups<cl_short>(engine, buffer_Temp, vector_elements, "min_reduce_dc_vec",
+        Kernel_time_min, Total_mem_time_min, Overall_time_min);
+    cout << "Calculated Min = " << *min_element(mins.begin(), mins.end()) / 10.0f << endl;
+    std::cout << "\nKernel execution time [ns]: " << Kernel_time_min << std::endl;
+    std::cout << "Total memory transfer time [ns]: " << Total_mem_time_min << std::endl;
+    std::cout << "Overall Opetation Time [ns]: " << Overall_time_min << std::endl;
+
+    //**********MAXIMUM**********
+    cout << "\n******MAXIMUM******" << endl;
+    int Kernel_time_max = 0;
+    int Total_mem_time_max = 0;
+    int Overall_time_max = 0;
+    vector<cl_short> maxs = reduce_dc_groups<cl_short>(engine, buffer_Temp, vector_elements, "max_reduce_dc_vec",
+        Kernel_time_max, Total_mem_time_max, Overall_time_max);
+    cout << "Calculated Max = " << *max_element(maxs.begin(), maxs.end()) / 10.0f << endl;
+    std::cout << "\nKernel execution time [ns]: " << Kernel_time_max << std::endl;
+    std::cout << "Total memory transfer time [ns]: " << Total_mem_time_max << std::endl;
+    std::cout << "Overall Opetation Time [ns]: " << Overall_time_max << std::endl;
+
+    //**********Standard Deviation
+    cout << "\n******STANDARD DEVIATION******" << endl;
+    //var = E[t^2] - E[t]^2 with both sums exact integers, so there is no need for a separate map pass with the mean
+    int Kernel_time_sd = 0;
+    int Total_mem_time_sd = 0;
+    int Overall_time_sd = 0;
+    vector<cl_long> squares = reduce_dc_groups<cl_long>(engine, buffer_Temp, vector_elements, "reduce_sq_dc_vec",
+        Kernel_time_sd, Total_mem_time_sd, Overall_time_sd);
+    long long sumsq = 0;
+    for (cl_long group_sumsq : squares)
+        sumsq += group_sumsq;
+    double var = fixed_squared_deviations(sum, sumsq, vector_elements) / vector_elements;
+    cout << "Calculated SD = ";
+    printf("%.1f\n", sqrt(max(0.0, var)) / 10);
+    std::cout << "\nKernel execution time [ns]: " << Kernel_time_sd << std::endl;
+    std::cout << "Total memory transfer time [ns]: " << Total_mem_time_sd << std::endl;
+    std::cout << "Overall Opetation Time [ns]: " << Overall_time_sd << std::endl;
+
+    engine.buffers().release(buffer_Temp);
+
+    //**Total Performance Metrics**
+    Total_Kernel_time = Kernel_time_min + Kernel_time_max + Kernel_time_sd + Kernel_time_mean;
+    Total_mem_time = write_time + Total_mem_time_min + Total_mem_time_max + Total_mem_time_sd + Total_mem_time_mean;
+    Total_program_time = write_time + Overall_time_min + Overall_time_max + Overall_time_sd + Overall_time_mean;
 }
 
 
 
 //Non-optimised methods
-void minimum_non_optimised(std::vector<float> Temperatures_unpadded, cl::Context context, cl::Program program, size_t workgroupSize, cl::CommandQueue queue,
-    int& Kernel_time, int& Total_mem_time, int& Overall_time, int counter) {
+void minimum_non_optimised(WeatherStatsEngine& engine, std::vector<float> Temperatures_unpadded, int& Kernel_time, int& Total_mem_time, int& Overall_time) {
+    cl::Context context = engine.context();
+    cl::Program program = engine.program();
+    cl::CommandQueue queue = engine.queue();
+    size_t workgroupSize = engine.workgroupSize();
     // Finds the minimum element the non-optimised way. Code is almost identical to the optimised version bar a few tweaks
-    vector<float> Temperatures_min = padding(Temperatures_unpadded, workgroupSize, 1000, false);
-
-    size_t vector_elements = Temperatures_min.size();
-    size_t vector_size = Temperatures_min.size() * sizeof(float);
+    // min_reduce is told the real element count, so the input is uploaded as it is and only the launch is rounded up
+    size_t vector_elements = Temperatures_unpadded.size();
+    size_t global_elements = (vector_elements + workgroupSize - 1) / workgroupSize * workgroupSize;
+    size_t vector_size = Temperatures_unpadded.size() * sizeof(float);
 
-    std::vector<float> Output_min(vector_elements, 1000); // non-optimised version keeps the output vector the same length
+    std::vector<float> Output_min(global_elements); // non-optimised version keeps the output vector the same length
     size_t output_size_min = Output_min.size() * sizeof(float);
 
     cl::Buffer buffer_Temp_min(context, CL_MEM_READ_WRITE, vector_size);
@@ -601,19 +1011,20 @@ void minimum_non_optimised(std::vector<float> Temperatures_unpadded, cl::Context
     cl::Event write_event;
 
     // copy to device memory
-    queue.enqueueWriteBuffer(buffer_Temp_min, CL_TRUE, 0, vector_size, &Temperatures_min[0], NULL, &write_event);
+    queue.enqueueWriteBuffer(buffer_Temp_min, CL_TRUE, 0, vector_size, &Temperatures_unpadded[0], NULL, &write_event);
     queue.enqueueFillBuffer(buffer_Out_min, 0, 0, output_size_min);
 
     // setup kenerl
     cl::Kernel kernel_min = cl::Kernel(program, "min_reduce");
     kernel_min.setArg(0, buffer_Temp_min);
-    kernel_min.setArg(1, buffer_Out_min);
-    kernel_min.setArg(2, cl::Local(workgroupSize * sizeof(float)));
+    kernel_min.setArg(1, (int)vector_elements);
+    kernel_min.setArg(2, buffer_Out_min);
+    kernel_min.setArg(3, cl::Local(workgroupSize * sizeof(float)));
 
     cl::Event kernel_event;
 
     // execute kernel
-    queue.enqueueNDRangeKernel(kernel_min, cl::NullRange, cl::NDRange(vector_elements), cl::NDRange(workgroupSize), NULL, &kernel_event);
+    queue.enqueueNDRangeKernel(kernel_min, cl::NullRange, cl::NDRange(global_elements), cl::NDRange(workgroupSize), NULL, &kernel_event);
 
     cl::Event read_event;
 
@@ -630,27 +1041,26 @@ void minimum_non_optimised(std::vector<float> Temperatures_unpadded, cl::Context
     Total_mem_time += write_time + read_time;
     Overall_time += Current_mem_time + Current_Kernel_Time;
 
-    // non-optimised version runs the reduction more, after these 5 runs the output array will contain the min...
-    if (counter < 5) {
-        counter++;
-        minimum(Output_min, context, program, workgroupSize, queue, Kernel_time, Total_mem_time, Overall_time, counter);
-    }
-    //...no need for running sequentially over the vector as it has been reduced enough times 
-    else {
-        cout << "Calculated Min = " << Output_min[0] << endl;
-    }
+    // the non-optimised version then uploads the per-group results (the first global_elements / workgroupSize values of...
+    // ...the output) again and the engine's multi-pass driver reduces them the rest of the way
+    DeviceDataset next(context, queue, &Output_min[0], global_elements / workgroupSize);
+    Total_mem_time += next.uploadTime();
+    Overall_time += next.uploadTime();
+    minimum(engine, next.temperatures(), next.size(), Kernel_time, Total_mem_time, Overall_time);
 }
 
-void maximum_non_optimised(std::vector<float> Temperatures_unpadded, cl::Context context, cl::Program program, size_t workgroupSize, cl::CommandQueue queue,
-    int& Kernel_time, int& Total_mem_time, int& Overall_time, int counter) {
-    //The following is almost identical to the minimum_non_optimised method - Major differences are the array is padded...
-    //...with '-1000' instead of '1000' and 'max_reduce' is the kernel called, not 'min_reduce'
-    vector<float> Temperatures_max = padding(Temperatures_unpadded, workgroupSize, -1000, false);
-
-    size_t vector_elements = Temperatures_max.size();
-    size_t vector_size = Temperatures_max.size() * sizeof(float);
-
-    std::vector<float> Output_max(vector_elements, 1000);
+void maximum_non_optimised(WeatherStatsEngine& engine, std::vector<float> Temperatures_unpadded, int& Kernel_time, int& Total_mem_time, int& Overall_time) {
+    cl::Context context = engine.context();
+    cl::Program program = engine.program();
+    cl::CommandQueue queue = engine.queue();
+    size_t workgroupSize = engine.workgroupSize();
+    //The following is almost identical to the minimum_non_optimised method - Major difference is 'max_reduce' is the kernel called, not 'min_reduce'
+    // max_reduce is told the real element count, so the input is uploaded as it is and only the launch is rounded up
+    size_t vector_elements = Temperatures_unpadded.size();
+    size_t global_elements = (vector_elements + workgroupSize - 1) / workgroupSize * workgroupSize;
+    size_t vector_size = Temperatures_unpadded.size() * sizeof(float);
+
+    std::vector<float> Output_max(global_elements);
     size_t output_size_max = Output_max.size() * sizeof(float);
 
     cl::Buffer buffer_Temp_max(context, CL_MEM_READ_WRITE, vector_size);
@@ -659,19 +1069,20 @@ void maximum_non_optimised(std::vector<float> Temperatures_unpadded, cl::Context
     cl::Event write_event;
 
     // copy to device memory
-    queue.enqueueWriteBuffer(buffer_Temp_max, CL_TRUE, 0, vector_size, &Temperatures_max[0], NULL, &write_event);
+    queue.enqueueWriteBuffer(buffer_Temp_max, CL_TRUE, 0, vector_size, &Temperatures_unpadded[0], NULL, &write_event);
     queue.enqueueFillBuffer(buffer_Out_max, 0, 0, output_size_max);
 
     // setup kenerl
     cl::Kernel kernel_max = cl::Kernel(program, "max_reduce");
     kernel_max.setArg(0, buffer_Temp_max);
-    kernel_max.setArg(1, buffer_Out_max);
-    kernel_max.setArg(2, cl::Local(workgroupSize * sizeof(float)));//local memory size
+    kernel_max.setArg(1, (int)vector_elements);
+    kernel_max.setArg(2, buffer_Out_max);
+    kernel_max.setArg(3, cl::Local(workgroupSize * sizeof(float)));//local memory size
 
     cl::Event kernel_event;
 
     // execute kernel
-    queue.enqueueNDRangeKernel(kernel_max, cl::NullRange, cl::NDRange(vector_elements), cl::NDRange(workgroupSize), NULL, &kernel_event);
+    queue.enqueueNDRangeKernel(kernel_max, cl::NullRange, cl::NDRange(global_elements), cl::NDRange(workgroupSize), NULL, &kernel_event);
 
     cl::Event read_event;
 
@@ -688,17 +1099,18 @@ void maximum_non_optimised(std::vector<float> Temperatures_unpadded, cl::Context
     Total_mem_time += write_time + read_time;
     Overall_time += Current_mem_time + Current_Kernel_Time;
 
-    if (counter < 5) {
-        counter++;
-        maximum(Output_max, context, program, workgroupSize, queue, Kernel_time, Total_mem_time, Overall_time, counter);
-    }
-    else {
-        cout << "Calculated Max = " << Output_max[0] << endl;
-    }
+    // the non-optimised version then uploads the per-group results (the first global_elements / workgroupSize values of...
+    // ...the output) again and the engine's multi-pass driver reduces them the rest of the way
+    DeviceDataset next(context, queue, &Output_max[0], global_elements / workgroupSize);
+    Total_mem_time += next.uploadTime();
+    Overall_time += next.uploadTime();
+    maximum(engine, next.temperatures(), next.size(), Kernel_time, Total_mem_time, Overall_time);
 }
 
-void execute_non_optimised_program(std::vector<float> Temperatures_unpadded, cl::Context context, cl::Program program, 
-    size_t workgroupSize, cl::CommandQueue queue, int& Total_Kernel_time, int& Total_mem_time, int& Total_program_time){
+void execute_non_optimised_program(WeatherStatsEngine& engine, std::vector<float> Temperatures_unpadded, int& Total_Kernel_time, int& Total_mem_time, int& Total_program_time){
+    cl::Context context = engine.context();
+    cl::Program program = engine.program();
+    cl::CommandQueue queue = engine.queue();
     //code alsmost identical to 'execute_non_optimised_program' except we are now running the methods for the non-optimised algorithm
 
     //**********MEAN**********  
@@ -706,16 +1118,20 @@ void execute_non_optimised_program(std::vector<float> Temperatures_unpadded, cl:
     int Kernel_time_mean = 0;
     int Total_mem_time_mean = 0;
     int Overall_time_mean = 0;
-    mean(Temperatures_unpadded, context, program, workgroupSize, queue, meanVal, Kernel_time_mean, Total_mem_time_mean, Overall_time_mean, false);
+    //the non-optimised program uploads the dataset again for each statistic
+    DeviceDataset dataset_mean(context, queue, &Temperatures_unpadded[0], Temperatures_unpadded.size());
+    Total_mem_time_mean += dataset_mean.uploadTime();
+    Overall_time_mean += dataset_mean.uploadTime();
+    mean(engine, dataset_mean.temperatures(), dataset_mean.size(), meanVal, Kernel_time_mean, Total_mem_time_mean, Overall_time_mean, false);
 
     //***********MINIMUM**********      
     cout << "\n******MINIMUM******" << endl;
 
-    //call the min_reduce function multiple times to perform multi-pass reduction     
+    //min_reduce is run as many times as the multi-pass driver needs for this input size
     int Kernel_time_min = 0;
     int Total_mem_time_min = 0;
     int Overall_time_min = 0;
-    minimum_non_optimised(Temperatures_unpadded, context, program, workgroupSize, queue, Kernel_time_min, Total_mem_time_min, Overall_time_min, 0);
+    minimum_non_optimised(engine, Temperatures_unpadded, Kernel_time_min, Total_mem_time_min, Overall_time_min);
 
     std::cout << "\nKernel execution time [ns]: " << Kernel_time_min << std::endl;
     std::cout << "Total memory transfer time [ns]: " << Total_mem_time_min << std::endl;
@@ -728,7 +1144,7 @@ void execute_non_optimised_program(std::vector<float> Temperatures_unpadded, cl:
     int Total_mem_time_max = 0;
     int Overall_time_max = 0;
     //cout << "Actual Max = " << *std::max_element(std::begin(Temperatures_unpadded), std::end(Temperatures_unpadded)) << endl;
-    maximum_non_optimised(Temperatures_unpadded, context, program, workgroupSize, queue, Kernel_time_max, Total_mem_time_max, Overall_time_max, 0);
+    maximum_non_optimised(engine, Temperatures_unpadded, Kernel_time_max, Total_mem_time_max, Overall_time_max);
 
     std::cout << "\nKernel execution time [ns]: " << Kernel_time_max << std::endl;
     std::cout << "Total memory transfer time [ns]: " << Total_mem_time_max << std::endl;
@@ -753,7 +1169,10 @@ void execute_non_optimised_program(std::vector<float> Temperatures_unpadded, cl:
     int Overall_time_sd = 0;
     int sampleSize = Temperatures_unpadded.size();
 
-    sd(Temperatures_unpadded, context, program, workgroupSize, queue,Kernel_time_sd, Total_mem_time_sd, Overall_time_sd, meanVal, sampleSize, false);
+    DeviceDataset dataset_sd(context, queue, &Temperatures_unpadded[0], Temperatures_unpadded.size());
+    Total_mem_time_sd += dataset_sd.uploadTime();
+    Overall_time_sd += dataset_sd.uploadTime();
+    sd(engine, dataset_sd.temperatures(), dataset_sd.size(), Kernel_time_sd, Total_mem_time_sd, Overall_time_sd, meanVal, sampleSize, false);
 
     //int Kernel_time_sd_atomic = 0;
     //int Total_mem_time_sd_atomic = 0;
@@ -763,10 +1182,6 @@ void execute_non_optimised_program(std::vector<float> Temperatures_unpadded, cl:
     std::cout << "Total memory transfer time [ns]: " << Total_mem_time_sd << std::endl;
     std::cout << "Overall Opetation Time [ns]: " << Overall_time_sd << std::endl;
 
-    //**Bitonic sort**
-    //cout << "\n******BITONIC SORT******" << endl;
-    //bitonic(Temperatures_unpadded, context, program, workgroupSize, queue, 0);
-
     //**Total Performance Metrics**
     Total_Kernel_time = Kernel_time_min + Kernel_time_max + Kernel_time_sd + Kernel_time_mean;
     Total_mem_time = Total_mem_time_min + Total_mem_time_max + Total_mem_time_sd + Total_mem_time_mean;
@@ -775,6 +1190,203 @@ void execute_non_optimised_program(std::vector<float> Temperatures_unpadded, cl:
 
 }
 
+//Streaming methods
+//Small blocking queue of slot indices used to hand parsed chunks from the parsing thread to the device thread
+class SlotQueue {
+public:
+    void push(int slot) {
+        {
+            lock_guard<mutex> lock(mutex_);
+            slots_.push_back(slot);
+        }
+        ready_.notify_one();
+    }
+
+    int pop() {
+        unique_lock<mutex> lock(mutex_);
+        ready_.wait(lock, [this]() { return !slots_.empty(); });
+        int slot = slots_.front();
+        slots_.pop_front();
+        return slot;
+    }
+
+private:
+    mutex mutex_;
+    condition_variable ready_;
+    deque<int> slots_;
+};
+
+void execute_streaming_program(const string& path, cl::Context context, cl::Program program, size_t workgroupSize, cl::CommandQueue queue,
+    size_t chunk_bytes) {
+    //Parses, uploads and reduces the dataset one fixed-size chunk at a time so the three stages overlap:
+    //...a producer thread parses chunk i+1 while chunk i is uploaded with a non-blocking write on a transfer queue and
+    //...reduced on the compute queue. Each chunk is reduced to per-work-group (sum, sumsq, min, max) partials which
+    //...are merged into running totals on the host, so the whole dataset never has to be in memory at once.
+    //Host chunk buffers: 3 so the parser can run ahead, device buffers: 2 (double buffering)
+    cout << "\n******STREAMING******" << endl;
+    auto start = chrono::high_resolution_clock::now();
+
+    MappedFile file(path);
+    unsigned int chunks = (unsigned int)max((size_t)1, (file.size() + chunk_bytes - 1) / chunk_bytes);
+    vector<size_t> bounds = splitAtNewlines(file.data(), file.size(), chunks);
+
+    size_t max_chunk = 0;
+    for (unsigned int c = 0; c < chunks; c++)
+        max_chunk = max(max_chunk, bounds[c + 1] - bounds[c]);
+    //starting size of the device buffers. The estimate assumes full length lines, a chunk of shorter ones can parse
+    //...to more rows, and then its device slot is reallocated before the upload
+    size_t capacity = estimateRecordCount(max_chunk);
+    capacity = (capacity + workgroupSize - 1) / workgroupSize * workgroupSize;
+
+    const int host_slots = 3;
+    const int device_slots = 2;
+    vector<vector<float>> chunk_values(host_slots);
+    SlotQueue free_slots, ready_slots;
+    for (int s = 0; s < host_slots; s++)
+        free_slots.push(s);
+
+    //producer - parse each chunk into a free host slot. A -1 from free_slots cancels it, and an exception ends the
+    //...stream early and is re-thrown on this thread once the producer has been joined
+    double parse_ms = 0;
+    exception_ptr producer_error;
+    thread producer([&]() {
+        try {
+            for (unsigned int c = 0; c < chunks; c++) {
+                int slot = free_slots.pop();
+                if (slot < 0)
+                    break;
+                auto parse_start = chrono::high_resolution_clock::now();
+                chunk_values[slot].clear();
+                parseTemperatures(file.data() + bounds[c], bounds[c + 1] - bounds[c], chunk_values[slot]);
+                parse_ms += chrono::duration<double, milli>(chrono::high_resolution_clock::now() - parse_start).count();
+                ready_slots.push(slot);
+            }
+        }
+        catch (...) {
+            producer_error = current_exception();
+        }
+        ready_slots.push(-1);
+    });
+
+    //cancels and joins the producer however this function is left, a cl::Error below would otherwise destroy a
+    //...joinable thread and terminate the program before main can report it
+    struct ProducerJoin {
+        thread& producer;
+        SlotQueue& free_slots;
+        ~ProducerJoin() {
+            if (producer.joinable()) {
+                free_slots.push(-1);
+                producer.join();
+            }
+        }
+    } producer_join = { producer, free_slots };
+
+    cl::CommandQueue transfer_queue(context, CL_QUEUE_PROFILING_ENABLE);
+    cl::Kernel kernel_moments = cl::Kernel(program, "moments_partial");
+
+    cl::Buffer buffer_chunk[device_slots];
+    cl::Buffer buffer_partials[device_slots];
+    vector<cl_float4> partials[device_slots];
+    cl::Event write_event[device_slots], kernel_event[device_slots], read_event[device_slots];
+    int host_slot_of[device_slots] = { -1, -1 };
+    size_t groups_of[device_slots] = { 0, 0 };
+    size_t capacity_of[device_slots] = { 0, 0 };
+    auto allocate = [&](int d, size_t values) {
+        capacity_of[d] = values;
+        buffer_chunk[d] = cl::Buffer(context, CL_MEM_READ_ONLY, values * sizeof(float));
+        buffer_partials[d] = cl::Buffer(context, CL_MEM_WRITE_ONLY, values / workgroupSize * sizeof(cl_float4));
+        partials[d].resize(values / workgroupSize);
+    };
+    for (int d = 0; d < device_slots; d++)
+        allocate(d, capacity);
+
+    //running aggregates, kept in double on the host
+    size_t count = 0;
+    double sum = 0, sumsq = 0;
+    float minTemp = INFINITY, maxTemp = -INFINITY;
+    long long write_time = 0, kernel_time = 0, read_time = 0;
+
+    auto retire = [&](int d) {
+        //wait for device slot d's last chunk to be reduced and fold its partials into the totals
+        if (host_slot_of[d] < 0)
+            return;
+        read_event[d].wait();
+        for (size_t g = 0; g < groups_of[d]; g++) {
+            sum += partials[d][g].s[0];
+            sumsq += partials[d][g].s[1];
+            minTemp = min(minTemp, partials[d][g].s[2]);
+            maxTemp = max(maxTemp, partials[d][g].s[3]);
+        }
+        write_time += write_event[d].getProfilingInfo<CL_PROFILING_COMMAND_END>() - write_event[d].getProfilingInfo<CL_PROFILING_COMMAND_START>();
+        kernel_time += kernel_event[d].getProfilingInfo<CL_PROFILING_COMMAND_END>() - kernel_event[d].getProfilingInfo<CL_PROFILING_COMMAND_START>();
+        read_time += read_event[d].getProfilingInfo<CL_PROFILING_COMMAND_END>() - read_event[d].getProfilingInfo<CL_PROFILING_COMMAND_START>();
+        host_slot_of[d] = -1;
+    };
+
+    for (unsigned int c = 0; ; c++) {
+        int slot = ready_slots.pop();
+        if (slot < 0)
+            break;
+
+        int d = c % device_slots;
+        retire(d); //device buffer d is free again once its previous chunk has been reduced
+
+        size_t rows = chunk_values[slot].size();
+        count += rows;
+        if (rows == 0) {
+            free_slots.push(slot);
+            continue;
+        }
+        size_t global_size = (rows + workgroupSize - 1) / workgroupSize * workgroupSize;
+        if (global_size > capacity_of[d])
+            allocate(d, global_size); //retired above, nothing on the device still uses the old buffers
+        groups_of[d] = global_size / workgroupSize;
+        host_slot_of[d] = slot;
+
+        transfer_queue.enqueueWriteBuffer(buffer_chunk[d], CL_FALSE, 0, rows * sizeof(float), &chunk_values[slot][0], NULL, &write_event[d]);
+        transfer_queue.flush();
+
+        kernel_moments.setArg(0, buffer_chunk[d]);
+        kernel_moments.setArg(1, (int)rows);
+        kernel_moments.setArg(2, buffer_partials[d]);
+        kernel_moments.setArg(3, cl::Local(workgroupSize * sizeof(cl_float4)));
+
+        vector<cl::Event> wait_write = { write_event[d] };
+        queue.enqueueNDRangeKernel(kernel_moments, cl::NullRange, cl::NDRange(global_size), cl::NDRange(workgroupSize), &wait_write, &kernel_event[d]);
+        queue.enqueueReadBuffer(buffer_partials[d], CL_FALSE, 0, groups_of[d] * sizeof(cl_float4), &partials[d][0], NULL, &read_event[d]);
+        queue.flush();
+
+        //the host copy can be handed back to the parser as soon as it has been uploaded
+        write_event[d].wait();
+        free_slots.push(slot);
+    }
+
+    for (int d = 0; d < device_slots; d++)
+        retire(d);
+    producer.join();
+    if (producer_error)
+        rethrow_exception(producer_error);
+
+    double total_ms = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+    double meanVal = count ? sum / count : 0;
+    double sdVal = count ? sqrt(max(0.0, sumsq / count - meanVal * meanVal)) : 0;
+
+    cout << "Streamed " << count << " records in " << chunks << " chunks of ~" << chunk_bytes / (1024 * 1024) << " MB" << endl;
+    cout << "Calculated Mean: ";
+    printf("%.1f\n", meanVal);
+    cout << "Calculated Min = " << minTemp << endl;
+    cout << "Calculated Max = " << maxTemp << endl;
+    cout << "Calculated SD = ";
+    printf("%.1f\n", sdVal);
+
+    std::cout << "\nParse time (producer thread) [ms]: " << parse_ms << std::endl;
+    std::cout << "Upload time [ms]: " << write_time / 1e6 << std::endl;
+    std::cout << "Kernel execution time [ms]: " << kernel_time / 1e6 << std::endl;
+    std::cout << "Partials read time [ms]: " << read_time / 1e6 << std::endl;
+    std::cout << "Sum of stages [ms]: " << parse_ms + (write_time + kernel_time + read_time) / 1e6 << std::endl;
+    std::cout << "End-to-end time [ms]: " << total_ms << std::endl;
+}
+
 //Program Entry
 /*
 This programme calculates the mean, minimum, maximum, and standard deviation of the supplied dataset. 
@@ -782,10 +1394,9 @@ It begins by extracting the temperature values as floats from the dataset. The p
 The first section contains the optimised methods and calculates the statistical values in the most optimised way possible. 
 The second section contains the Non-optimised methods and calculates the statistics in a very in-efficient manner.
 Original developments include the way I have gotten around atomic_add() not allowing floats. 
-I split the reduced value into integer and decimal values. 
-The decimal value was multiplied by 10 to convert to an integer (only 10 as we only care about 1 d.p.). 
-Then both values were atomically added to the vector separately. 
-When complete the final reduction equalled the decimal value (converted to a float and divided by 10) plus the integer value (converted to a float).
+Every value is scaled to a whole number (x10 as we only care about 1 d.p.) and summed exactly as a 64 bit integer. 
+Work-group sums are added with 64 bit atomics where the device has cl_khr_int64_base_atomics, otherwise each group writes a partial sum 
+and the (at most 1024) partials are added on the host. The final sum is divided by 10 once, so there is no drift however large the dataset.
 
 The main optimisations used were to utilise local storage through creating local copies of the input vectors and splitting the vectors into workgroups. 
 The workgroup size was 32 as this was stated as the preferred size when the kernels were queried. 
@@ -795,55 +1406,195 @@ Atomic functions were used sparingly but, in some cases, they were proven to be
 When recursion was used, it was only used up to the point where the output was less than 1000 - The final calculations were done sequentially. 
 This saved resources as the transferring of so few items to and from a kernel would have taken longer than running it sequentially.
 */
-int main()
+int main(int argc, char** argv)
 {    
+    //command line options
+    //  --threads N     number of threads used to parse the dataset (1 = single threaded readFile)
+    //  --bench-parse   time every parser on the dataset and exit
+    //  --no-cache      always parse the text file, don't read or write the binary column cache
+    //  --stream        parse, upload and reduce the dataset in overlapping chunks instead of loading it all first
+    //  --chunk-mb N    chunk size used by --stream (default 16)
+    //  --fixed-point   run the optimised statistics on int16 tenths of a degree instead of floats
+    //  --separate-kernels  run the optimised mean/min/max/SD as separate kernels instead of the fused single pass
+    //  --repeat N      run the fused statistics N more times on the same engine, to show the per-query cost
+    //  --dataset PATH  dataset to load (default temp_lincolnshire_datasets/temp_lincolnshire.txt)
+    //  --bench-reduce  time the interleaved and sequential-addressing reduction kernels on the dataset and exit
+    //  --sort-median   take the median and quartiles from a full device sort instead of the histogram
+    //  --autotune      sweep work-group size, groups per compute unit and host-finish threshold, save the device's profile
+    //  --async         submit the optimised mean/min/max/SD as one graph of non-blocking enqueues and wait once
+    //  --queues N      like --async, with the independent statistics spread over N queues (or one out-of-order queue)
+    //  --multi-device  split the mean/min/max/SD over every usable OpenCL device by measured throughput and exit
+    //  --cpu-split N   with --multi-device, partition each CPU device into N sub-devices where the runtime allows it
+    //  --platform P --device D  run on this platform and device (ListPlatformsDevices order) instead of the probed one
+    //  --reprobe       probe every device again even if this host's saved selection is still current
+    unsigned int parse_threads = max(1u, thread::hardware_concurrency());
+    bool bench_parse = false;
+    bool use_cache = true;
+    bool stream = false;
+    size_t chunk_bytes = 16 * 1024 * 1024;
+    bool fixed_point = false;
+    bool fused = true;
+    int repeat = 0;
+    string dataset_path = "temp_lincolnshire_datasets/temp_lincolnshire.txt";
+    bool bench_reduce = false;
+    bool autotune = false;
+    bool sort_median = false;
+    bool async = false;
+    size_t lanes = 1;
+    bool multi_device = false;
+    unsigned int cpu_split = 0;
+    int platform_id = -1;
+    int device_id = 0;
+    bool reprobe = false;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc)
+            parse_threads = max(1, atoi(argv[++i]));
+        else if (arg == "--bench-parse")
+            bench_parse = true;
+        else if (arg == "--no-cache")
+            use_cache = false;
+        else if (arg == "--stream")
+            stream = true;
+        else if (arg == "--chunk-mb" && i + 1 < argc)
+            chunk_bytes = (size_t)max(1, atoi(argv[++i])) * 1024 * 1024;
+        else if (arg == "--fixed-point")
+            fixed_point = true;
+        else if (arg == "--separate-kernels")
+            fused = false;
+        else if (arg == "--repeat" && i + 1 < argc)
+            repeat = max(0, atoi(argv[++i]));
+        else if (arg == "--dataset" && i + 1 < argc)
+            dataset_path = argv[++i];
+        else if (arg == "--bench-reduce")
+            bench_reduce = true;
+        else if (arg == "--autotune")
+            autotune = true;
+        else if (arg == "--sort-median")
+            sort_median = true;
+        else if (arg == "--async")
+            async = true;
+        else if (arg == "--queues" && i + 1 < argc) {
+            lanes = (size_t)max(1, atoi(argv[++i]));
+            async = true;
+        }
+        else if (arg == "--multi-device")
+            multi_device = true;
+        else if (arg == "--cpu-split" && i + 1 < argc)
+            cpu_split = (unsigned int)max(0, atoi(argv[++i]));
+        else if (arg == "--platform" && i + 1 < argc)
+            platform_id = max(0, atoi(argv[++i]));
+        else if (arg == "--device" && i + 1 < argc)
+            device_id = max(0, atoi(argv[++i]));
+        else if (arg == "--reprobe")
+            reprobe = true;
+    }
+
     try {
-        //hardcoded to use the devices GPU due to its parallel abilities
-        int platform_id = 1;
-        int device_id = 0;
+        if (bench_parse) {
+            benchmarkParsers(dataset_path, parse_threads);
+            return 0;
+        }
+
+        size_t workgroupSize = 32;//Value found by running - kernel_reduce.getWorkGroupInfo<CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE>(device);...
+        //...in basic implementation. Only used until --autotune has written a profile for this device
+
+        if (multi_device) {
+            //every device gets its own context, so the single selected one below isn't needed
+            WeatherTable table;
+            loadDataset(table, parse_threads, use_cache, dataset_path);
+            execute_multi_device_program(table.temperature.data(), table.size(), workgroupSize, cpu_split);
+            return 0;
+        }
+
+        //the fastest device found by a short probe of every platform's devices, saved per host and only probed again
+        //...when the devices or drivers change. --platform picks one by hand instead
+        if (platform_id < 0) {
+            DeviceSelection selection = selectDevice("kernels/kernels.cl", workgroupSize, reprobe);
+            platform_id = selection.platform_id;
+            device_id = selection.device_id;
+        }
 
         cl::Context context = GetContext(platform_id, device_id);
+        if (!context())
+            throw std::runtime_error("No OpenCL device " + to_string(platform_id) + ":" + to_string(device_id) + ", the devices are:\n" + ListPlatformsDevices());
         std::cout << "Runinng on " << GetPlatformName(platform_id) << ", " << GetDeviceName(platform_id, device_id) << std::endl;
 
-        cl::CommandQueue queue(context, CL_QUEUE_PROFILING_ENABLE);
-        cl::Program::Sources sources;
-        AddSources(sources, "kernels/kernels.cl");
-        cl::Program program(context, sources);
-
-        //build and debug the kernel code
-        try {
-            program.build();
+        //launch settings measured by --autotune on this device and driver, picked up automatically on later runs
+        WeatherTable table;
+        TuningProfile profile;
+        string profile_path = tuningProfilePath(deviceName(context), driverVersion(context));
+        if (autotune) {
+            loadDataset(table, parse_threads, use_cache, dataset_path);
+            profile = autotuneDevice(context, "kernels/kernels.cl", table.temperature.data(), table.size());
+            if (profile.workgroup_size && profile.save(profile_path))
+                std::cout << "Tuning profile saved to " << profile_path << std::endl;
         }
-        catch (const cl::Error& err) {
-            std::cout << "Build Status: " << program.getBuildInfo<CL_PROGRAM_BUILD_STATUS>(context.getInfo<CL_CONTEXT_DEVICES>()[0]) << std::endl;
-            std::cout << "Build Options:\t" << program.getBuildInfo<CL_PROGRAM_BUILD_OPTIONS>(context.getInfo<CL_CONTEXT_DEVICES>()[0]) << std::endl;
-            std::cout << "Build Log:\t " << program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(context.getInfo<CL_CONTEXT_DEVICES>()[0]) << std::endl;
-            throw err;
+        else if (profile.load(profile_path) && profile.matches(deviceName(context), driverVersion(context))) {
+            std::cout << "Using tuning profile " << profile_path << std::endl;
+        }
+        else {
+            profile = TuningProfile();
+        }
+        if (profile.workgroup_size)
+            workgroupSize = profile.workgroup_size;
+
+        //the engine builds the program and owns the queue, kernels and device buffers for the rest of the run
+        WeatherStatsEngine engine(context, "kernels/kernels.cl", workgroupSize);
+        applyTuningProfile(engine, profile);
+        cl::CommandQueue queue = engine.queue();
+        cl::Program program = engine.program();
+
+        if (stream) {
+            execute_streaming_program(dataset_path, context, program, workgroupSize, queue, chunk_bytes);
+            return 0;
         }
 
-        vector<float> Temperatures_unpadded;
+        if (!autotune) //already loaded for tuning
+            loadDataset(table, parse_threads, use_cache, dataset_path);
 
-        readFile(Temperatures_unpadded);
+        if (bench_reduce) {
+            engine.upload(table.temperature.data(), table.size());
+            benchmark_reductions(engine);
+            return 0;
+        }
+
+        //the statistics only need the temperature column
+        vector<float> Temperatures_unpadded(table.temperature.begin(), table.temperature.end());
 
-        cl::Device device = context.getInfo<CL_CONTEXT_DEVICES>()[0]; // get device
-        size_t workgroupSize = 32;//Value found by running - kernel_reduce.getWorkGroupInfo<CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE>(device);...
-        //...in basic implementation. Cant actually use this line in code as kernel not defined yet
 
         //**********OPTIMISED PROGRAM**********
         cout << "\n--------------------------------------Executing Optimised Program--------------------------------------" << endl;
         int Total_Kernel_time_O = 0; //_O = optimised
         int Total_mem_time_O = 0;
         int Total_program_time_O = 0;
-        execute_optimised_program(Temperatures_unpadded, context, program, workgroupSize, queue, Total_Kernel_time_O, Total_mem_time_O, Total_program_time_O);
-
-        //bitonic(Temperatures_unpadded,context,program,workgroupSize,queue);
+        if (fixed_point) {
+            execute_fixed_point_program(engine, table.tenths, Total_Kernel_time_O, Total_mem_time_O, Total_program_time_O);
+        }
+        else {
+            //uploaded once, straight from the column, and shared by every statistic of the optimised program
+            engine.upload(table.temperature.data(), table.size());
+            if (async)
+                execute_async_program(engine, Total_Kernel_time_O, Total_mem_time_O, Total_program_time_O, lanes);
+            else
+                execute_optimised_program(engine, Total_Kernel_time_O, Total_mem_time_O, Total_program_time_O, fused, sort_median);
+
+            //further queries on the same engine reuse its kernels, buffers and resident data - no setup at all
+            for (int r = 0; r < repeat; r++) {
+                size_t allocations = engine.buffers().allocations();
+                WeatherStats stats = engine.compute(STAT_ALL);
+                cout << "\nRepeat " << r + 1 << ": mean " << stats.mean << ", min " << stats.min << ", max " << stats.max << ", sd " << stats.sd
+                    << " | kernel [ns]: " << stats.kernel_time << ", read [ns]: " << stats.transfer_time << ", host [ms]: " << stats.host_time
+                    << ", new buffers: " << engine.buffers().allocations() - allocations << endl;
+            }
+        }
 
         //**********NON-OPTIMISED PROGRAM*********
         cout << "\n--------------------------------------Executing Non-Optimised Program--------------------------------------" << endl;
         int Total_Kernel_time_NO = 0; //_NO = non-optimised
         int Total_mem_time_NO = 0;
         int Total_program_time_NO = 0;
-        execute_non_optimised_program(Temperatures_unpadded, context, program, workgroupSize, queue, Total_Kernel_time_NO, Total_mem_time_NO, Total_program_time_NO);
+        execute_non_optimised_program(engine, Temperatures_unpadded, Total_Kernel_time_NO, Total_mem_time_NO, Total_program_time_NO);
 
         //Program Performance output
         cout << "\n--------------------------------------Program Performance Comparison--------------------------------------" << endl;
@@ -864,6 +1615,9 @@ int main()
     catch (cl::Error err) {
         cerr << "ERROR: " << err.what() << ", " << getErrorString(err.err()) << std::endl;
     }
+    catch (const std::exception& err) {
+        cerr << "ERROR: " << err.what() << std::endl;
+    }
 
     return 0;
 }
\ No newline at end of file
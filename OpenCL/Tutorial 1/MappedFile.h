@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <stdexcept>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+//Read-only memory mapping of a whole file. The dataset is scanned straight out of the page cache
+//...so there is no per-line string allocation and no copy into an intermediate buffer
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path) {
+#ifdef _WIN32
+        file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (file_ == INVALID_HANDLE_VALUE)
+            throw std::runtime_error("Could not open " + path);
+
+        LARGE_INTEGER file_size;
+        GetFileSizeEx(file_, &file_size);
+        size_ = (size_t)file_size.QuadPart;
+
+        //an empty file can't be mapped, leave data_ as NULL and let callers see size() == 0
+        if (size_) {
+            mapping_ = CreateFileMappingA(file_, NULL, PAGE_READONLY, 0, 0, NULL);
+            if (mapping_ == NULL) {
+                CloseHandle(file_);
+                throw std::runtime_error("Could not map " + path);
+            }
+            data_ = (const char*)MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+        }
+#else
+        fd_ = open(path.c_str(), O_RDONLY);
+        if (fd_ < 0)
+            throw std::runtime_error("Could not open " + path);
+
+        struct stat st;
+        fstat(fd_, &st);
+        size_ = (size_t)st.st_size;
+
+        if (size_) {
+            void* addr = mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+            if (addr == MAP_FAILED) {
+                close(fd_);
+                throw std::runtime_error("Could not map " + path);
+            }
+            //the file is read front to back exactly once, tell the kernel to read ahead aggressively
+            madvise(addr, size_, MADV_SEQUENTIAL);
+            data_ = (const char*)addr;
+        }
+#endif
+    }
+
+    ~MappedFile() {
+#ifdef _WIN32
+        if (data_) UnmapViewOfFile(data_);
+        if (mapping_) CloseHandle(mapping_);
+        if (file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+#else
+        if (data_) munmap((void*)data_, size_);
+        if (fd_ >= 0) close(fd_);
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    const char* data_ = NULL;
+    size_t size_ = 0;
+#ifdef _WIN32
+    HANDLE file_ = INVALID_HANDLE_VALUE;
+    HANDLE mapping_ = NULL;
+#else
+    int fd_ = -1;
+#endif
+};
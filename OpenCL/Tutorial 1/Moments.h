@@ -0,0 +1,51 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+
+#include "Utils.h"
+
+//One work-group's result from the moments_fused kernel, laid out exactly like the kernel's Moments struct:
+//...number of values, their mean, the sum of squared differences from that mean (M2) and the extremes
+struct MomentsPartial {
+    cl_uint count;
+    cl_float mean;
+    cl_float m2;
+    cl_float min;
+    cl_float max;
+};
+
+//Count, mean, variance and extremes of a set of values, accumulated in double on the host.
+//Partials are combined with Chan et al.'s pairwise update, which merges (count, mean, M2) directly instead of
+//...going through sum and sum of squares, so the variance doesn't lose its digits to cancellation
+struct Moments {
+    double count = 0;
+    double mean = 0;
+    double m2 = 0;
+    float min = INFINITY;
+    float max = -INFINITY;
+
+    void merge(double other_count, double other_mean, double other_m2, float other_min, float other_max) {
+        min = std::min(min, other_min);
+        max = std::max(max, other_max);
+        if (other_count == 0)
+            return;
+        double total = count + other_count;
+        double delta = other_mean - mean;
+        mean += delta * other_count / total;
+        m2 += other_m2 + delta * delta * count * other_count / total;
+        count = total;
+    }
+
+    void merge(const MomentsPartial& partial) {
+        merge(partial.count, partial.mean, partial.m2, partial.min, partial.max);
+    }
+
+    void merge(const Moments& other) {
+        merge(other.count, other.mean, other.m2, other.min, other.max);
+    }
+
+    //population variance, as used by the rest of the program
+    double variance() const { return count ? m2 / count : 0; }
+    double sd() const { return sqrt(variance()); }
+};
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Utils.h"
+#include "Moments.h"
+#include "TuningProfile.h"
+#include "Autotuner.h"
+#include "WeatherStatsEngine.h"
+
+//One device's part of a multi-device run: its engine, how fast it measured, the slice of the dataset it was given
+//...and what it computed from it
+struct DeviceShare {
+    std::string name;
+    std::unique_ptr<WeatherStatsEngine> engine;
+    double throughput = 0; //values per ns for an upload plus a fused pass, measured on a sample
+    size_t offset = 0;
+    size_t count = 0;
+    WeatherStats stats;
+    double time = 0; //ms, wall clock for uploading and computing the slice
+    std::string error;
+};
+
+//Every device on every platform that is available and can compile the kernels. With 'cpu_split' > 1 a CPU device that
+//...can be partitioned equally is replaced by sub-devices of 1/cpu_split of its compute units (pocl and the Intel CPU
+//...runtime both allow this), so one CPU takes several slices. A device that refuses the split is used whole
+std::vector<cl::Device> usableDevices(unsigned int cpu_split = 0) {
+    std::vector<cl::Device> usable;
+    std::vector<cl::Platform> platforms;
+    cl::Platform::get(&platforms);
+    for (cl::Platform& platform : platforms) {
+        std::vector<cl::Device> devices;
+        try {
+            platform.getDevices(CL_DEVICE_TYPE_ALL, &devices);
+        }
+        catch (const cl::Error&) {
+            continue; //a platform without devices reports CL_DEVICE_NOT_FOUND
+        }
+        for (cl::Device& device : devices) {
+            if (!device.getInfo<CL_DEVICE_AVAILABLE>() || !device.getInfo<CL_DEVICE_COMPILER_AVAILABLE>())
+                continue;
+            if (cpu_split > 1 && (device.getInfo<CL_DEVICE_TYPE>() & CL_DEVICE_TYPE_CPU)) {
+                cl_uint units = device.getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>();
+                std::vector<cl_device_partition_property> partitions = device.getInfo<CL_DEVICE_PARTITION_PROPERTIES>();
+                if (units >= cpu_split && std::find(partitions.begin(), partitions.end(), CL_DEVICE_PARTITION_EQUALLY) != partitions.end()) {
+                    cl_device_partition_property properties[] = { CL_DEVICE_PARTITION_EQUALLY, (cl_device_partition_property)(units / cpu_split), 0 };
+                    std::vector<cl::Device> sub_devices;
+                    try {
+                        device.createSubDevices(properties, &sub_devices);
+                        usable.insert(usable.end(), sub_devices.begin(), sub_devices.end());
+                        continue;
+                    }
+                    catch (const cl::Error& err) {
+                        //advertised but refused for this count, the whole device still takes a slice
+                        std::cout << "Not splitting " << device.getInfo<CL_DEVICE_NAME>() << ": " << err.what() << ", " << getErrorString(err.err()) << std::endl;
+                    }
+                }
+            }
+            usable.push_back(device);
+        }
+    }
+    return usable;
+}
+
+//An engine on the context's device with the device's tuning profile when --autotune has written one, otherwise with
+//...'workgroupSize' halved until the device allows it
+std::unique_ptr<WeatherStatsEngine> createTunedEngine(cl::Context context, const std::string& kernel_path, size_t workgroupSize) {
+    cl::Device device = context.getInfo<CL_CONTEXT_DEVICES>()[0];
+    TuningProfile profile;
+    if (profile.load(tuningProfilePath(deviceName(context), driverVersion(context))) && profile.matches(deviceName(context), driverVersion(context)))
+        workgroupSize = profile.workgroup_size;
+    else
+        profile = TuningProfile();
+    while (workgroupSize > 1 && workgroupSize > device.getInfo<CL_DEVICE_MAX_WORK_GROUP_SIZE>())
+        workgroupSize /= 2;
+    std::unique_ptr<WeatherStatsEngine> engine(new WeatherStatsEngine(context, kernel_path, workgroupSize));
+    applyTuningProfile(*engine, profile);
+    return engine;
+}
+
+//An engine on every usable device (see createTunedEngine). A device whose build fails is reported and left out
+std::vector<DeviceShare> createDeviceShares(const std::string& kernel_path, size_t workgroupSize, unsigned int cpu_split = 0) {
+    std::vector<DeviceShare> shares;
+    for (cl::Device& device : usableDevices(cpu_split)) {
+        DeviceShare share;
+        share.name = device.getInfo<CL_DEVICE_NAME>();
+        try {
+            share.engine = createTunedEngine(cl::Context(device), kernel_path, workgroupSize);
+        }
+        catch (const cl::Error& err) {
+            std::cout << "Skipping " << share.name << ": " << err.what() << ", " << getErrorString(err.err()) << std::endl;
+            continue;
+        }
+        shares.push_back(std::move(share));
+    }
+    return shares;
+}
+
+//Values per ns a device gets through for the two things its slice will cost: the upload and a fused pass. Timed on
+//...the first 'count' values after a warm up pass, from the profiling events
+double measureThroughput(WeatherStatsEngine& engine, const float* values, size_t count) {
+    engine.upload(values, count);
+    engine.compute(STAT_ALL);
+    WeatherStats stats = engine.compute(STAT_ALL);
+    double time = (double)engine.dataset().uploadTime() + stats.kernel_time + stats.transfer_time;
+    return time > 0 ? count / time : 0;
+}
+
+//Split 'count' values into consecutive slices in proportion to each share's throughput, equally if none was measured
+void partitionByThroughput(std::vector<DeviceShare>& shares, size_t count) {
+    double total = 0;
+    for (const DeviceShare& share : shares)
+        total += share.throughput;
+    size_t offset = 0;
+    for (size_t s = 0; s < shares.size(); s++) {
+        double fraction = total > 0 ? shares[s].throughput / total : 1.0 / shares.size();
+        size_t slice = (s + 1 == shares.size()) ? count - offset : std::min(count - offset, (size_t)(count * fraction));
+        shares[s].offset = offset;
+        shares[s].count = slice;
+        offset += slice;
+    }
+}
+
+//Measure every share, split the values between them, then upload and reduce every slice at the same time (one host
+//...thread per device, each device has its own context and queue). The partial moments and extremes of the slices are
+//...merged on the host with the same pairwise update as the work-group partials, so the result is that of one pass
+//...over all the values. Throws if any device fails, since its slice would be missing from the result
+Moments computeAcrossDevices(std::vector<DeviceShare>& shares, const float* values, size_t count, size_t calibration_count = 1 << 20) {
+    if (shares.empty())
+        throw std::runtime_error("No usable OpenCL devices");
+    size_t sample = std::min(count, calibration_count);
+    for (DeviceShare& share : shares)
+        share.throughput = sample ? measureThroughput(*share.engine, values, sample) : 0;
+    partitionByThroughput(shares, count);
+
+    std::vector<std::thread> workers;
+    for (DeviceShare& share : shares) {
+        if (!share.count)
+            continue;
+        workers.push_back(std::thread([&share, values]() {
+            try {
+                auto start = std::chrono::high_resolution_clock::now();
+                share.engine->upload(values + share.offset, share.count);
+                share.stats = share.engine->compute(STAT_ALL);
+                share.time = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+            }
+            catch (const cl::Error& err) {
+                share.error = std::string(err.what()) + ", " + getErrorString(err.err());
+            }
+            catch (const std::exception& err) {
+                share.error = err.what();
+            }
+        }));
+    }
+    for (std::thread& worker : workers)
+        worker.join();
+
+    Moments merged;
+    for (const DeviceShare& share : shares) {
+        if (!share.error.empty())
+            throw std::runtime_error(share.name + " failed: " + share.error);
+        merged.merge(share.stats.moments);
+    }
+    return merged;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//How many times each temperature occurs, in tenths of a degree from min_tenths upwards (bin b counts
+//...(min_tenths + b) / 10 degrees), as counted by the histogram_tenths kernel. Every statistic below is exact and
+//...costs one walk over the bins, however many values were counted
+struct TemperatureHistogram {
+    int min_tenths = 0;
+    std::vector<uint32_t> counts;
+    uint64_t total = 0;
+
+    float value(size_t bin) const { return (min_tenths + (int)bin) / 10.0f; }
+
+    //k-th smallest value counted, from 0
+    float orderStatistic(uint64_t k) const {
+        uint64_t seen = 0;
+        for (size_t bin = 0; bin < counts.size(); bin++) {
+            seen += counts[bin];
+            if (seen > k)
+                return value(bin);
+        }
+        return counts.empty() ? 0.0f : value(counts.size() - 1);
+    }
+
+    //q-th quantile, interpolating linearly between the two nearest ranks like the sorted version does, so both give
+    //...the same answer
+    float quantile(double q) const {
+        if (!total)
+            return 0.0f;
+        double rank = q * (total - 1);
+        uint64_t lower = (uint64_t)rank;
+        float lower_value = orderStatistic(lower);
+        if (lower + 1 >= total)
+            return lower_value;
+        float upper_value = orderStatistic(lower + 1);
+        return (float)(lower_value + (rank - lower) * (upper_value - lower_value));
+    }
+
+    float median() const { return quantile(0.5); }
+    float iqr() const { return quantile(0.75) - quantile(0.25); }
+
+    //most frequent value, the lowest one if several share the top count
+    float mode() const {
+        size_t best = 0;
+        for (size_t bin = 1; bin < counts.size(); bin++) {
+            if (counts[bin] > counts[best])
+                best = bin;
+        }
+        return value(best);
+    }
+};
@@ -0,0 +1,241 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define PARSER_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+//GCC/Clang only emit AVX2 instructions inside functions that ask for them, MSVC allows the intrinsics anywhere.
+//The AVX2 code is only ever called after the runtime check below so the rest of the program still runs on any x86
+#if defined(PARSER_X86) && defined(__GNUC__)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+enum SimdLevel {
+    SIMD_SCALAR = 0,
+    SIMD_SSE2 = 1,
+    SIMD_AVX2 = 2
+};
+
+const char* simdLevelName(SimdLevel level) {
+    switch (level) {
+    case SIMD_AVX2: return "AVX2";
+    case SIMD_SSE2: return "SSE2";
+    default: return "scalar";
+    }
+}
+
+//Query the CPU once for the widest line scanner it can run
+SimdLevel detectSimdLevel() {
+#if defined(PARSER_X86) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    int max_leaf = info[0];
+    __cpuid(info, 1);
+    bool sse2 = (info[3] & (1 << 26)) != 0;
+    //AVX state also has to be enabled by the OS (OSXSAVE + XCR0 bits 1 and 2)
+    bool os_avx = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && ((_xgetbv(0) & 6) == 6);
+    bool avx2 = false;
+    if (max_leaf >= 7 && os_avx) {
+        __cpuidex(info, 7, 0);
+        avx2 = (info[1] & (1 << 5)) != 0;
+    }
+    return avx2 ? SIMD_AVX2 : (sse2 ? SIMD_SSE2 : SIMD_SCALAR);
+#elif defined(PARSER_X86) && defined(__GNUC__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return SIMD_AVX2;
+    if (__builtin_cpu_supports("sse2"))
+        return SIMD_SSE2;
+    return SIMD_SCALAR;
+#else
+    return SIMD_SCALAR;
+#endif
+}
+
+SimdLevel activeSimdLevel() {
+    static const SimdLevel level = detectSimdLevel();
+    return level;
+}
+
+inline unsigned int countTrailingZeros(uint32_t mask) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (unsigned int)index;
+#else
+    return (unsigned int)__builtin_ctz(mask);
+#endif
+}
+
+inline bool isDigit(char c) {
+    return (unsigned)(c - '0') < 10;
+}
+
+//Fixed-format decimal parser for the temperature column ("-?D+.D"). Much cheaper than atof as it
+//...skips locale handling, exponents, inf/nan etc. The value is built as an integer number of tenths and
+//...divided once at the end, so one decimal place values come out exactly as atof would give them
+float parseTemperature(const char* p, const char* end) {
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = (*p == '-');
+        p++;
+    }
+
+    int value = 0;
+    while (p < end && isDigit(*p)) {
+        value = value * 10 + (*p - '0');
+        p++;
+    }
+
+    int scale = 1;
+    if (p < end && *p == '.') {
+        p++;
+        while (p < end && isDigit(*p)) {
+            value = value * 10 + (*p - '0');
+            scale *= 10;
+            p++;
+        }
+    }
+
+    float temp = (float)value / scale;
+    return negative ? -temp : temp;
+}
+
+//Decode the temperature at the end of one line, both as a float and as a whole number of tenths of a degree
+//...(the fixed point form every reading in the dataset fits exactly). Nearly every row ends in "-?D?D.D" so that
+//...shape is read straight off the last few bytes without searching for the column start. Anything else (no decimal
+//...point, three integer digits, several decimals) drops back to walking to the last space and parseTemperature,
+//...with tenths rounded to nearest. Returns false for blank lines
+inline bool decodeTrailingTemperature(const char* line, const char* line_end, float& temp, int& tenths) {
+    const char* e = line_end;
+    while (e > line && (e[-1] == '\r' || e[-1] == ' '))
+        e--;
+    if (e == line)
+        return false;
+
+    if (e - line >= 6 && e[-2] == '.' && isDigit(e[-1]) && isDigit(e[-3]) && !(isDigit(e[-4]) && isDigit(e[-5]))) {
+        tenths = (e[-3] - '0') * 10 + (e[-1] - '0');
+        char sign = e[-4];
+        if (isDigit(e[-4])) {
+            tenths += (e[-4] - '0') * 100;
+            sign = e[-5];
+        }
+        if (sign == '-')
+            tenths = -tenths;
+        temp = (float)tenths / 10;
+        return true;
+    }
+
+    const char* field = e;
+    while (field > line && field[-1] != ' ')
+        field--;
+    temp = parseTemperature(field, e);
+    tenths = (int)floor(temp * 10 + 0.5f);
+    return true;
+}
+
+inline bool decodeTrailingTemperature(const char* line, const char* line_end, float& temp) {
+    int tenths;
+    return decodeTrailingTemperature(line, line_end, temp, tenths);
+}
+
+//Line scanners. Each one calls sink(line_begin, line_end) for every line in [data, data + size), line_end
+//...pointing at the '\n' (or the end of the buffer for a final line without one). They only differ in how
+//...the newlines are found: memchr, 16 bytes per compare (SSE2) or 32 bytes per compare (AVX2)
+template <typename Sink>
+void scanLinesFrom(const char* line_start, const char* p, const char* end, Sink& sink) {
+    while (p < end) {
+        const char* nl = (const char*)memchr(p, '\n', end - p);
+        if (!nl)
+            break;
+        sink(line_start, nl);
+        line_start = p = nl + 1;
+    }
+    if (line_start < end)
+        sink(line_start, end);
+}
+
+template <typename Sink>
+void scanLinesScalar(const char* data, size_t size, Sink& sink) {
+    scanLinesFrom(data, data, data + size, sink);
+}
+
+#ifdef PARSER_X86
+template <typename Sink>
+void scanLinesSse2(const char* data, size_t size, Sink& sink) {
+    const __m128i newline = _mm_set1_epi8('\n');
+    const char* line_start = data;
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i*)(data + i));
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(block, newline));
+        while (mask) {
+            const char* nl = data + i + countTrailingZeros(mask);
+            sink(line_start, nl);
+            line_start = nl + 1;
+            mask &= mask - 1;
+        }
+    }
+    scanLinesFrom(line_start, data + i, data + size, sink);
+}
+
+template <typename Sink>
+TARGET_AVX2 void scanLinesAvx2(const char* data, size_t size, Sink& sink) {
+    const __m256i newline = _mm256_set1_epi8('\n');
+    const char* line_start = data;
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m256i block = _mm256_loadu_si256((const __m256i*)(data + i));
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, newline));
+        while (mask) {
+            const char* nl = data + i + countTrailingZeros(mask);
+            sink(line_start, nl);
+            line_start = nl + 1;
+            mask &= mask - 1;
+        }
+    }
+    scanLinesFrom(line_start, data + i, data + size, sink);
+}
+#endif
+
+//Runtime dispatch to the widest scanner the CPU supports (or the one asked for, used by the benchmark)
+template <typename Sink>
+void scanLines(const char* data, size_t size, Sink& sink, SimdLevel level = activeSimdLevel()) {
+#ifdef PARSER_X86
+    if (level >= SIMD_AVX2 && activeSimdLevel() >= SIMD_AVX2) {
+        scanLinesAvx2(data, size, sink);
+        return;
+    }
+    if (level >= SIMD_SSE2 && activeSimdLevel() >= SIMD_SSE2) {
+        scanLinesSse2(data, size, sink);
+        return;
+    }
+#endif
+    scanLinesScalar(data, size, sink);
+}
+
+//Line sink writing the trailing temperature of every line into a vector that has been pre-sized from the
+//...file size. The size estimate assumes well formed records, so it still grows if a file is full of short lines
+struct TemperatureSink {
+    std::vector<float>& out;
+    size_t rows;
+
+    void operator()(const char* line, const char* line_end) {
+        if (rows == out.size())
+            out.resize(out.size() * 2 + 16);
+        if (decodeTrailingTemperature(line, line_end, out[rows]))
+            rows++;
+    }
+};
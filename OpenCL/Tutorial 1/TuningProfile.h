@@ -0,0 +1,250 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+
+//A string as a JSON string literal
+std::string jsonQuote(const std::string& text) {
+    std::string quoted = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+            quoted += c;
+        }
+        else if ((unsigned char)c < 0x20) {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned char)c);
+            quoted += escaped;
+        }
+        else
+            quoted += c;
+    }
+    return quoted + "\"";
+}
+
+//Just enough of a JSON reader for the files this program writes (tuning profiles, the device selection): objects,
+//...strings and numbers, with arrays, true, false and null only skipped over
+class JsonReader {
+public:
+    explicit JsonReader(const std::string& text) : p_(text.c_str()), end_(text.c_str() + text.size()) {}
+
+    //parse an object, calling member(key) with the reader positioned on each value
+    template <typename Member>
+    bool object(Member member) {
+        if (!consume('{'))
+            return false;
+        if (consume('}'))
+            return true;
+        do {
+            std::string key;
+            if (!string(key) || !consume(':') || !member(key))
+                return false;
+        } while (consume(','));
+        return consume('}');
+    }
+
+    bool string(std::string& value) {
+        if (!consume('"'))
+            return false;
+        value.clear();
+        while (p_ < end_ && *p_ != '"') {
+            if (*p_ == '\\') {
+                if (++p_ == end_)
+                    return false;
+                switch (*p_) {
+                case 'n': value += '\n'; break;
+                case 't': value += '\t'; break;
+                case 'r': value += '\r'; break;
+                case 'b': value += '\b'; break;
+                case 'f': value += '\f'; break;
+                case 'u': {
+                    //only the control characters jsonQuote() writes are expected here
+                    if (end_ - p_ < 5)
+                        return false;
+                    value += (char)strtol(std::string(p_ + 1, 4).c_str(), NULL, 16);
+                    p_ += 4;
+                    break;
+                }
+                default: value += *p_; break;
+                }
+            }
+            else
+                value += *p_;
+            p_++;
+        }
+        return consume('"');
+    }
+
+    bool number(double& value) {
+        space();
+        char* number_end;
+        value = strtod(p_, &number_end);
+        if (number_end == p_ || number_end > end_)
+            return false;
+        p_ = number_end;
+        return true;
+    }
+
+    bool size(size_t& value) {
+        double number_value;
+        if (!number(number_value) || number_value < 0)
+            return false;
+        value = (size_t)number_value;
+        return true;
+    }
+
+    bool skip() {
+        space();
+        if (p_ == end_)
+            return false;
+        if (*p_ == '"') {
+            std::string ignored;
+            return string(ignored);
+        }
+        if (*p_ == '{')
+            return object([this](const std::string&) { return skip(); });
+        if (*p_ == '[') {
+            p_++;
+            if (consume(']'))
+                return true;
+            do {
+                if (!skip())
+                    return false;
+            } while (consume(','));
+            return consume(']');
+        }
+        for (const char* word : { "true", "false", "null" }) {
+            size_t length = strlen(word);
+            if ((size_t)(end_ - p_) >= length && strncmp(p_, word, length) == 0) {
+                p_ += length;
+                return true;
+            }
+        }
+        double ignored;
+        return number(ignored);
+    }
+
+private:
+    void space() {
+        while (p_ < end_ && (*p_ == ' ' || *p_ == '\t' || *p_ == '\n' || *p_ == '\r'))
+            p_++;
+    }
+
+    bool consume(char c) {
+        space();
+        if (p_ < end_ && *p_ == c) {
+            p_++;
+            return true;
+        }
+        return false;
+    }
+
+    const char* p_;
+    const char* end_;
+};
+
+//Best launch settings found by the autotuner (Autotuner.h) for one kernel
+struct KernelTuning {
+    size_t groups_per_compute_unit = 0; //work-groups launched per compute unit, sets the elements per work-item
+    double elements_per_work_item = 0; //what that came to on the tuning dataset, for reference
+    double time_ns = 0; //kernel time at those settings on the tuning dataset
+};
+
+//Autotuned settings for one device and driver, stored as a small JSON file:
+//   { "device": "...", "driver": "...", "workgroup_size": 256, "host_finish_threshold": 16384,
+//     "kernels": { "min_reduce_vec": { "groups_per_compute_unit": 8, "elements_per_work_item": 110.5, "time_ns": 81234 }, ... } }
+//A profile only applies to the device and driver version it was measured on, both are part of the file name and
+//...checked again on load, so a driver update means tuning again rather than running with stale settings
+struct TuningProfile {
+    std::string device;
+    std::string driver;
+    size_t workgroup_size = 0;
+    size_t host_finish_threshold = 0;
+    std::map<std::string, KernelTuning> kernels;
+
+    bool matches(const std::string& device_name, const std::string& driver_version) const {
+        return device == device_name && driver == driver_version && workgroup_size;
+    }
+
+    bool save(const std::string& path) const {
+        std::ofstream file(path);
+        if (!file)
+            return false;
+        file << "{\n";
+        file << "    \"device\": " << jsonQuote(device) << ",\n";
+        file << "    \"driver\": " << jsonQuote(driver) << ",\n";
+        file << "    \"workgroup_size\": " << workgroup_size << ",\n";
+        file << "    \"host_finish_threshold\": " << host_finish_threshold << ",\n";
+        file << "    \"kernels\": {";
+        const char* separator = "\n";
+        for (const auto& kernel : kernels) {
+            file << separator << "        " << jsonQuote(kernel.first) << ": { \"groups_per_compute_unit\": " << kernel.second.groups_per_compute_unit
+                << ", \"elements_per_work_item\": " << kernel.second.elements_per_work_item << ", \"time_ns\": " << kernel.second.time_ns << " }";
+            separator = ",\n";
+        }
+        file << "\n    }\n}\n";
+        return (bool)file;
+    }
+
+    //Read a profile written by save(). Unknown keys are skipped, anything that isn't valid JSON fails the load
+    bool load(const std::string& path) {
+        std::ifstream file(path);
+        if (!file)
+            return false;
+        std::stringstream contents;
+        contents << file.rdbuf();
+        std::string text = contents.str();
+
+        TuningProfile profile;
+        JsonReader json(text);
+        bool ok = json.object([&](const std::string& key) {
+            if (key == "device")
+                return json.string(profile.device);
+            if (key == "driver")
+                return json.string(profile.driver);
+            if (key == "workgroup_size")
+                return json.size(profile.workgroup_size);
+            if (key == "host_finish_threshold")
+                return json.size(profile.host_finish_threshold);
+            if (key == "kernels") {
+                return json.object([&](const std::string& kernel_name) {
+                    KernelTuning& tuning = profile.kernels[kernel_name];
+                    return json.object([&](const std::string& field) {
+                        if (field == "groups_per_compute_unit")
+                            return json.size(tuning.groups_per_compute_unit);
+                        if (field == "elements_per_work_item")
+                            return json.number(tuning.elements_per_work_item);
+                        if (field == "time_ns")
+                            return json.number(tuning.time_ns);
+                        return json.skip();
+                    });
+                });
+            }
+            return json.skip();
+        });
+        if (!ok)
+            return false;
+        *this = profile;
+        return true;
+    }
+};
+
+//'text' with every character that can't go in a file name replaced, so any device or host name works
+std::string fileNameKey(const std::string& text) {
+    std::string key;
+    for (char c : text) {
+        bool safe = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '.' || c == '-';
+        key += safe ? c : '_';
+    }
+    return key;
+}
+
+//Profile file for a device and driver, in the working directory
+std::string tuningProfilePath(const std::string& device_name, const std::string& driver_version) {
+    return "tuning_" + fileNameKey(device_name + "_" + driver_version) + ".json";
+}
@@ -0,0 +1,249 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "MappedFile.h"
+#include "WeatherData.h"
+
+//Binary columnar cache of a parsed dataset (".wxc"), written next to the text file after the first parse so
+//...later runs skip text parsing entirely. Layout (native endianness):
+//   WeatherCacheHeader
+//   station dictionary: one length byte + name bytes per station
+//   station | year | month | day | minute | temperature | tenths columns, each starting on a CACHE_ALIGNMENT boundary
+//The loader maps the file and points the table's columns straight at the mapped arrays, no copy is made.
+//A cache is only trusted if it was built from a source file with the same size and modification time, or
+//...failing the time check, the same content hash. Anything else is treated as stale and rebuilt
+
+const char CACHE_MAGIC[8] = { 'W', 'X', 'C', 'A', 'C', 'H', 'E', '1' };
+const uint32_t CACHE_VERSION = 2;
+const uint64_t CACHE_ALIGNMENT = 64;
+
+struct WeatherCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint64_t source_size;
+    int64_t source_mtime;
+    uint64_t source_hash;
+    uint64_t rows;
+    uint64_t stations;
+    uint64_t names_offset;
+    uint64_t station_offset;
+    uint64_t year_offset;
+    uint64_t month_offset;
+    uint64_t day_offset;
+    uint64_t minute_offset;
+    uint64_t temperature_offset;
+    uint64_t tenths_offset;
+    uint64_t file_size;
+};
+
+std::string cachePathFor(const std::string& source_path) {
+    size_t dot = source_path.find_last_of('.');
+    size_t slash = source_path.find_last_of("/\\");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        return source_path + ".wxc";
+    return source_path.substr(0, dot) + ".wxc";
+}
+
+//Size and modification time of a file, the time in nanoseconds where the platform has it, since a cache built in
+//...the same second the source was edited would otherwise look up to date
+bool sourceStatus(const std::string& path, uint64_t& size, int64_t& mtime) {
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA info;
+    if (!GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &info))
+        return false;
+    size = ((uint64_t)info.nFileSizeHigh << 32) | info.nFileSizeLow;
+    mtime = (int64_t)((((uint64_t)info.ftLastWriteTime.dwHighDateTime << 32) | info.ftLastWriteTime.dwLowDateTime) * 100);
+#else
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0)
+        return false;
+    size = (uint64_t)st.st_size;
+#if defined(__APPLE__)
+    mtime = (int64_t)st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+    mtime = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+#endif
+    return true;
+}
+
+//64-bit content hash, 8 bytes per step (multiply/xor-shift mixing). Only used to tell whether a source whose
+//...timestamp changed still has the same bytes, so it needs to be fast rather than cryptographic
+uint64_t hashBytes(const char* data, size_t size) {
+    const uint64_t prime = 0x9E3779B97F4A7C15ull;
+    uint64_t h = 0xCBF29CE484222325ull ^ (size * prime);
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        h = (h ^ word) * prime;
+        h ^= h >> 29;
+    }
+    for (; i < size; i++)
+        h = (h ^ (unsigned char)data[i]) * prime;
+    h ^= h >> 32;
+    return h;
+}
+
+//What a cache header records about its source. Captured by the parse itself (see readFile), the size and time before
+//...the file is mapped and the hash from the same mapping the parser reads, so the header can't describe a newer file
+//...than the one the columns came from
+struct WeatherCacheSource {
+    uint64_t size = 0;
+    int64_t mtime = 0;
+    uint64_t hash = 0;
+};
+
+uint64_t alignCacheOffset(uint64_t offset) {
+    return (offset + CACHE_ALIGNMENT - 1) / CACHE_ALIGNMENT * CACHE_ALIGNMENT;
+}
+
+//Try to load 'table' from the cache for source_path. Returns false if there is no usable cache
+bool loadWeatherCache(const std::string& source_path, WeatherTable& table) {
+    std::string cache_path = cachePathFor(source_path);
+    uint64_t source_size;
+    int64_t source_mtime;
+    uint64_t cache_size;
+    int64_t cache_mtime;
+    if (!sourceStatus(source_path, source_size, source_mtime) || !sourceStatus(cache_path, cache_size, cache_mtime))
+        return false;
+    if (cache_size < sizeof(WeatherCacheHeader))
+        return false;
+
+    std::shared_ptr<MappedFile> cache = std::make_shared<MappedFile>(cache_path);
+    WeatherCacheHeader header;
+    memcpy(&header, cache->data(), sizeof(header));
+
+    if (memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 || header.version != CACHE_VERSION ||
+        header.header_size != sizeof(WeatherCacheHeader) || header.file_size != cache->size())
+        return false;
+    if (header.source_size != source_size)
+        return false;
+    if (header.source_mtime != source_mtime) {
+        //touched but possibly unchanged (copied, checked out again...) - fall back to comparing content
+        MappedFile source(source_path);
+        if (hashBytes(source.data(), source.size()) != header.source_hash)
+            return false;
+    }
+
+    //a cache that was cut short or scribbled over must not be read past its end
+    uint64_t rows64 = header.rows;
+    if (header.stations > 256 || header.tenths_offset + rows64 * sizeof(int16_t) != header.file_size ||
+        header.temperature_offset + rows64 * sizeof(float) > header.tenths_offset ||
+        header.station_offset + rows64 > header.year_offset || header.year_offset + rows64 * 2 > header.month_offset ||
+        header.month_offset + rows64 > header.day_offset || header.day_offset + rows64 > header.minute_offset ||
+        header.minute_offset + rows64 * 2 > header.temperature_offset || header.names_offset > header.station_offset)
+        return false;
+
+    const char* base = cache->data();
+    size_t rows = (size_t)header.rows;
+
+    table.clear();
+    const char* name = base + header.names_offset;
+    const char* names_end = base + header.station_offset;
+    for (uint64_t i = 0; i < header.stations; i++) {
+        if (name >= names_end || name + 1 + (unsigned char)*name > names_end) {
+            table.clear();
+            return false;
+        }
+        unsigned char length = (unsigned char)*name++;
+        table.station_names.push_back(std::string(name, length));
+        name += length;
+    }
+    table.station.view((const uint8_t*)(base + header.station_offset), rows);
+    table.year.view((const uint16_t*)(base + header.year_offset), rows);
+    table.month.view((const uint8_t*)(base + header.month_offset), rows);
+    table.day.view((const uint8_t*)(base + header.day_offset), rows);
+    table.minute.view((const uint16_t*)(base + header.minute_offset), rows);
+    table.temperature.view((const float*)(base + header.temperature_offset), rows);
+    table.tenths.view((const int16_t*)(base + header.tenths_offset), rows);
+    table.mapping = cache;
+    return true;
+}
+
+//Write 'table', parsed from the source described by 'source', as the cache for source_path. The file is written under
+//...a temporary name and renamed into place, so a crash half way through can never leave a truncated cache that looks valid.
+//If the source's size or time no longer match 'source' once the cache is written, the source changed after it was
+//...parsed and the cache is thrown away
+//Returns false without writing anything if a station name is longer than the 255 bytes its length byte can hold
+bool writeWeatherCache(const std::string& source_path, const WeatherTable& table, const WeatherCacheSource& source) {
+    WeatherCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.version = CACHE_VERSION;
+    header.header_size = sizeof(WeatherCacheHeader);
+    header.source_size = source.size;
+    header.source_mtime = source.mtime;
+    header.source_hash = source.hash;
+
+    std::string names;
+    for (const std::string& station : table.station_names) {
+        //one length byte per name, a longer one would shift every name and column after it
+        if (station.size() > 255)
+            return false;
+        names.push_back((char)station.size());
+        names += station;
+    }
+
+    size_t rows = table.size();
+    header.rows = rows;
+    header.stations = table.station_names.size();
+    header.names_offset = sizeof(WeatherCacheHeader);
+    header.station_offset = alignCacheOffset(header.names_offset + names.size());
+    header.year_offset = alignCacheOffset(header.station_offset + rows * sizeof(uint8_t));
+    header.month_offset = alignCacheOffset(header.year_offset + rows * sizeof(uint16_t));
+    header.day_offset = alignCacheOffset(header.month_offset + rows * sizeof(uint8_t));
+    header.minute_offset = alignCacheOffset(header.day_offset + rows * sizeof(uint8_t));
+    header.temperature_offset = alignCacheOffset(header.minute_offset + rows * sizeof(uint16_t));
+    header.tenths_offset = alignCacheOffset(header.temperature_offset + rows * sizeof(float));
+    header.file_size = header.tenths_offset + rows * sizeof(int16_t);
+
+    std::string cache_path = cachePathFor(source_path);
+    std::string temp_path = cache_path + ".tmp";
+    FILE* file = fopen(temp_path.c_str(), "wb");
+    if (!file)
+        return false;
+
+    uint64_t written = 0;
+    auto write = [&](const void* bytes, uint64_t offset, uint64_t length) {
+        static const char zeros[CACHE_ALIGNMENT] = { 0 };
+        while (written < offset) {
+            size_t pad = fwrite(zeros, 1, (size_t)std::min<uint64_t>(offset - written, CACHE_ALIGNMENT), file);
+            if (!pad)
+                return; //disk full etc, the size check below catches it
+            written += pad;
+        }
+        if (length)
+            written += fwrite(bytes, 1, (size_t)length, file);
+    };
+    write(&header, 0, sizeof(header));
+    write(names.data(), header.names_offset, names.size());
+    write(table.station.data(), header.station_offset, rows * sizeof(uint8_t));
+    write(table.year.data(), header.year_offset, rows * sizeof(uint16_t));
+    write(table.month.data(), header.month_offset, rows * sizeof(uint8_t));
+    write(table.day.data(), header.day_offset, rows * sizeof(uint8_t));
+    write(table.minute.data(), header.minute_offset, rows * sizeof(uint16_t));
+    write(table.temperature.data(), header.temperature_offset, rows * sizeof(float));
+    write(table.tenths.data(), header.tenths_offset, rows * sizeof(int16_t));
+    bool ok = (written == header.file_size);
+    ok = (fclose(file) == 0) && ok;
+
+    uint64_t source_size;
+    int64_t source_mtime;
+    ok = ok && sourceStatus(source_path, source_size, source_mtime) && source_size == source.size && source_mtime == source.mtime;
+
+    if (ok) {
+        remove(cache_path.c_str()); //rename won't replace an existing file on windows
+        ok = (rename(temp_path.c_str(), cache_path.c_str()) == 0);
+    }
+    if (!ok)
+        remove(temp_path.c_str());
+    return ok;
+}
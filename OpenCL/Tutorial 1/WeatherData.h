@@ -0,0 +1,290 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "MappedFile.h"
+#include "TemperatureParser.h"
+
+//Assumed lower bound on the length of a record, used to size the output up front. A typical line such as
+//..."SCAMPTON 2000 01 01 0000 1.0\n" is 29 bytes, so file size / 24 is normally more rows than the file holds and
+//...the initial reserve is enough. A file of shorter lines still parses, the output then grows as it fills
+const size_t MIN_RECORD_BYTES = 24;
+
+size_t estimateRecordCount(size_t file_size) {
+    return file_size / MIN_RECORD_BYTES + 1;
+}
+
+//Parse the last column of every line in [data, data + size) and append it to Temperatures.
+//Lines are found by the widest SIMD newline scan the CPU supports and the temperature is decoded from the
+//...last few bytes before each newline, so only the bytes of the final column are ever looked at.
+//Returns the number of rows parsed
+size_t parseTemperatures(const char* data, size_t size, std::vector<float>& Temperatures, SimdLevel level = activeSimdLevel()) {
+    size_t offset = Temperatures.size();
+    Temperatures.resize(offset + estimateRecordCount(size));
+
+    TemperatureSink sink = { Temperatures, offset };
+    scanLines(data, size, sink, level);
+
+    Temperatures.resize(sink.rows);
+    return sink.rows - offset;
+}
+
+//Split [data, data + size) into roughly equal byte ranges for parallel parsing. Every range boundary is
+//...snapped forward to just after the next '\n' so no line is ever split between two ranges
+std::vector<size_t> splitAtNewlines(const char* data, size_t size, unsigned int ranges) {
+    std::vector<size_t> bounds(1, 0);
+    for (unsigned int i = 1; i < ranges; i++) {
+        size_t pos = std::max((size_t)((unsigned long long)size * i / ranges), bounds.back());
+        if (pos > 0 && pos < size && data[pos - 1] != '\n') {
+            const char* nl = (const char*)memchr(data + pos, '\n', size - pos);
+            pos = nl ? (size_t)(nl - data) + 1 : size;
+        }
+        bounds.push_back(pos);
+    }
+    bounds.push_back(size);
+    return bounds;
+}
+
+//Multi-threaded version of parseTemperatures. The file is cut at newline boundaries, each range is parsed on
+//...its own thread into a private segment, then every thread copies its segment into its slice of Temperatures.
+//The copy is only 4 bytes per ~31 byte row so it is cheap next to the parse, and it is also done in parallel
+size_t parseTemperaturesParallel(const char* data, size_t size, std::vector<float>& Temperatures, unsigned int threads) {
+    if (threads <= 1)
+        return parseTemperatures(data, size, Temperatures);
+
+    std::vector<size_t> bounds = splitAtNewlines(data, size, threads);
+    std::vector<std::vector<float>> segments(threads);
+    std::vector<size_t> offsets(threads + 1, Temperatures.size());
+
+    std::vector<std::thread> pool;
+    for (unsigned int t = 0; t < threads; t++) {
+        pool.emplace_back([&, t]() {
+            parseTemperatures(data + bounds[t], bounds[t + 1] - bounds[t], segments[t]);
+        });
+    }
+    for (auto& worker : pool)
+        worker.join();
+    pool.clear();
+
+    for (unsigned int t = 0; t < threads; t++)
+        offsets[t + 1] = offsets[t] + segments[t].size();
+    Temperatures.resize(offsets[threads]);
+
+    for (unsigned int t = 0; t < threads; t++) {
+        pool.emplace_back([&, t]() {
+            std::copy(segments[t].begin(), segments[t].end(), Temperatures.begin() + offsets[t]);
+            std::vector<float>().swap(segments[t]); //release the segment as soon as it has been copied
+        });
+    }
+    for (auto& worker : pool)
+        worker.join();
+
+    return offsets[threads] - offsets[0];
+}
+
+//One column of the WeatherTable. Either owns its values or is a read-only view of memory owned by someone else
+//...(a mapped cache file), so a cached dataset can go from disk to the device without an intermediate copy.
+//Reads never copy; writable()/resize() turn a view into an owned copy first
+template <typename T>
+class Column {
+public:
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    const T* data() const { return view_ ? view_ : owned_.data(); }
+    const T* begin() const { return data(); }
+    const T* end() const { return data() + size_; }
+    const T& operator[](size_t i) const { return data()[i]; }
+
+    T* writable() {
+        if (view_) {
+            owned_.assign(view_, view_ + size_);
+            view_ = NULL;
+        }
+        return owned_.data();
+    }
+
+    void resize(size_t rows) {
+        writable();
+        owned_.resize(rows);
+        size_ = rows;
+    }
+
+    void view(const T* values, size_t rows) {
+        std::vector<T>().swap(owned_);
+        view_ = values;
+        size_ = rows;
+    }
+
+private:
+    std::vector<T> owned_;
+    const T* view_ = NULL;
+    size_t size_ = 0;
+};
+
+//Column store holding every field of the dataset, one contiguous array per column (struct of arrays), so a
+//...kernel or SIMD loop only streams the columns it actually needs. Row i is
+//...(station_names[station[i]], year[i], month[i], day[i], minute[i], temperature[i])
+struct WeatherTable {
+    std::vector<std::string> station_names; //dictionary, station id -> name
+    Column<uint8_t> station;
+    Column<uint16_t> year;
+    Column<uint8_t> month;
+    Column<uint8_t> day;
+    Column<uint16_t> minute; //minute of the day, HHMM converted to HH * 60 + MM
+    Column<float> temperature;
+    Column<int16_t> tenths; //the same temperatures in fixed point, tenths of a degree (6.5 -> 65)
+
+    //keeps the memory behind view columns alive (set when the table was loaded from a cache file)
+    std::shared_ptr<MappedFile> mapping;
+
+    size_t size() const { return temperature.size(); }
+
+    void resize(size_t rows) {
+        station.resize(rows);
+        year.resize(rows);
+        month.resize(rows);
+        day.resize(rows);
+        minute.resize(rows);
+        temperature.resize(rows);
+        tenths.resize(rows);
+    }
+
+    void clear() {
+        station_names.clear();
+        resize(0);
+        mapping.reset();
+    }
+
+    //dictionary id for a station name, adding it if it is new. At most 256 stations fit in the uint8 column
+    uint8_t stationId(const char* name, size_t length) {
+        for (size_t i = 0; i < station_names.size(); i++) {
+            if (station_names[i].size() == length && memcmp(station_names[i].data(), name, length) == 0)
+                return (uint8_t)i;
+        }
+        if (station_names.size() > 255)
+            throw std::runtime_error("More than 256 weather stations in dataset");
+        station_names.push_back(std::string(name, length));
+        return (uint8_t)(station_names.size() - 1);
+    }
+};
+
+inline unsigned int parseField(const char*& p, const char* end) {
+    while (p < end && *p == ' ')
+        p++;
+    unsigned int value = 0;
+    while (p < end && isDigit(*p)) {
+        value = value * 10 + (*p - '0');
+        p++;
+    }
+    return value;
+}
+
+//Line sink decoding all six columns of a record straight into the table. The station name is matched against
+//...the previous row's station first since the files are grouped by station, so the dictionary is rarely searched
+struct WeatherRecordSink {
+    WeatherTable& table;
+    size_t rows;
+    int last_station;
+
+    void operator()(const char* line, const char* line_end) {
+        float temp;
+        int temp_tenths;
+        if (!decodeTrailingTemperature(line, line_end, temp, temp_tenths))
+            return;
+        if (rows == table.size())
+            table.resize(table.size() * 2 + 16);
+
+        const char* p = line;
+        while (p < line_end && *p == ' ')
+            p++;
+        const char* name = p;
+        while (p < line_end && *p != ' ')
+            p++;
+        size_t length = p - name;
+
+        if (last_station < 0 || table.station_names[last_station].size() != length ||
+            memcmp(table.station_names[last_station].data(), name, length) != 0)
+            last_station = table.stationId(name, length);
+
+        table.station.writable()[rows] = (uint8_t)last_station;
+        table.year.writable()[rows] = (uint16_t)parseField(p, line_end);
+        table.month.writable()[rows] = (uint8_t)parseField(p, line_end);
+        table.day.writable()[rows] = (uint8_t)parseField(p, line_end);
+        unsigned int hhmm = parseField(p, line_end);
+        table.minute.writable()[rows] = (uint16_t)((hhmm / 100) * 60 + hhmm % 100);
+        table.temperature.writable()[rows] = temp;
+        table.tenths.writable()[rows] = (int16_t)temp_tenths;
+        rows++;
+    }
+};
+
+//Parse every column of [data, data + size) into table in a single pass over the bytes. Returns rows parsed
+size_t parseWeatherTable(const char* data, size_t size, WeatherTable& table, SimdLevel level = activeSimdLevel()) {
+    size_t offset = table.size();
+    table.resize(offset + estimateRecordCount(size));
+
+    WeatherRecordSink sink = { table, offset, -1 };
+    scanLines(data, size, sink, level);
+
+    table.resize(sink.rows);
+    return sink.rows - offset;
+}
+
+//Multi-threaded version of parseWeatherTable, split the same way as parseTemperaturesParallel. Every thread
+//...builds its own station dictionary, so when the segments are copied into place the station ids are
+//...remapped onto the merged dictionary
+size_t parseWeatherTableParallel(const char* data, size_t size, WeatherTable& table, unsigned int threads) {
+    if (threads <= 1)
+        return parseWeatherTable(data, size, table);
+
+    std::vector<size_t> bounds = splitAtNewlines(data, size, threads);
+    std::vector<WeatherTable> segments(threads);
+    std::vector<size_t> offsets(threads + 1, table.size());
+
+    std::vector<std::thread> pool;
+    for (unsigned int t = 0; t < threads; t++) {
+        pool.emplace_back([&, t]() {
+            parseWeatherTable(data + bounds[t], bounds[t + 1] - bounds[t], segments[t]);
+        });
+    }
+    for (auto& worker : pool)
+        worker.join();
+    pool.clear();
+
+    std::vector<std::vector<uint8_t>> remap(threads);
+    for (unsigned int t = 0; t < threads; t++) {
+        offsets[t + 1] = offsets[t] + segments[t].size();
+        for (const std::string& name : segments[t].station_names)
+            remap[t].push_back(table.stationId(name.data(), name.size()));
+    }
+    table.resize(offsets[threads]);
+
+    for (unsigned int t = 0; t < threads; t++) {
+        pool.emplace_back([&, t]() {
+            WeatherTable& segment = segments[t];
+            size_t offset = offsets[t];
+            uint8_t* station = table.station.writable() + offset;
+            for (size_t i = 0; i < segment.size(); i++)
+                station[i] = remap[t][segment.station[i]];
+            std::copy(segment.year.begin(), segment.year.end(), table.year.writable() + offset);
+            std::copy(segment.month.begin(), segment.month.end(), table.month.writable() + offset);
+            std::copy(segment.day.begin(), segment.day.end(), table.day.writable() + offset);
+            std::copy(segment.minute.begin(), segment.minute.end(), table.minute.writable() + offset);
+            std::copy(segment.temperature.begin(), segment.temperature.end(), table.temperature.writable() + offset);
+            std::copy(segment.tenths.begin(), segment.tenths.end(), table.tenths.writable() + offset);
+            segment = WeatherTable(); //release the segment as soon as it has been copied
+        });
+    }
+    for (auto& worker : pool)
+        worker.join();
+
+    return offsets[threads] - offsets[0];
+}
@@ -0,0 +1,648 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Utils.h"
+#include "DeviceDataset.h"
+#include "Moments.h"
+#include "TemperatureHistogram.h"
+
+//Kernels that stride over their input (reduce_fixed, moments_fused) launch at most this many work-groups.
+//Keeps their partials arrays small enough that combining them on the host costs nothing
+const size_t STRIDED_MAX_GROUPS = 1024;
+
+//Work-groups launched per compute unit by the grid-stride kernels (see WeatherStatsEngine::stridedGroups). A few per
+//...compute unit lets one group's loads overlap another's while it waits on memory
+const size_t GROUPS_PER_COMPUTE_UNIT = 8;
+
+bool hasInt64Atomics(const cl::Device& device) {
+    return device.getInfo<CL_DEVICE_EXTENSIONS>().find("cl_khr_int64_base_atomics") != std::string::npos;
+}
+
+//OpenCL C version of the device's compiler as major * 10 + minor (12 for "OpenCL C 1.2 ...")
+int openclCVersion(const cl::Device& device) {
+    int major = 1, minor = 0;
+    sscanf(device.getInfo<CL_DEVICE_OPENCL_C_VERSION>().c_str(), "OpenCL C %d.%d", &major, &minor);
+    return major * 10 + minor;
+}
+
+//How the kernels' LOCAL_REDUCE combines a work-group, best first (see the top of kernels.cl)
+enum ReducePath {
+    REDUCE_WORK_GROUP, //OpenCL C 2.0 work_group_reduce_*
+    REDUCE_SUB_GROUP, //cl_khr_subgroups sub_group_reduce_*
+    REDUCE_TREE //local memory tree, works everywhere
+};
+
+const char* reducePathName(ReducePath path) {
+    switch (path) {
+    case REDUCE_WORK_GROUP: return "work_group_reduce";
+    case REDUCE_SUB_GROUP: return "sub_group_reduce";
+    default: return "local memory tree";
+    }
+}
+
+//Device buffers recycled by size. Sizes are rounded up to a power of two bucket so buffers of nearby sizes are
+//...shared, and a buffer handed back with release() is given out again instead of allocating a new one.
+//Only release a buffer once the commands using it have finished
+class BufferPool {
+public:
+    explicit BufferPool(cl::Context context) : context_(context) {}
+
+    cl::Buffer acquire(size_t bytes) {
+        std::vector<cl::Buffer>& free_list = free_[bucketSize(bytes)];
+        if (!free_list.empty()) {
+            cl::Buffer buffer = free_list.back();
+            free_list.pop_back();
+            return buffer;
+        }
+        allocations_++;
+        return cl::Buffer(context_, CL_MEM_READ_WRITE, bucketSize(bytes));
+    }
+
+    void release(const cl::Buffer& buffer) {
+        free_[buffer.getInfo<CL_MEM_SIZE>()].push_back(buffer);
+    }
+
+    static size_t bucketSize(size_t bytes) {
+        size_t size = 256;
+        while (size < bytes)
+            size *= 2;
+        return size;
+    }
+
+    //number of device buffers actually created so far
+    size_t allocations() const { return allocations_; }
+
+private:
+    cl::Context context_;
+    std::map<size_t, std::vector<cl::Buffer>> free_;
+    size_t allocations_ = 0;
+};
+
+enum WeatherStat {
+    STAT_MEAN = 1,
+    STAT_MIN = 2,
+    STAT_MAX = 4,
+    STAT_SD = 8,
+    STAT_ALL = STAT_MEAN | STAT_MIN | STAT_MAX | STAT_SD
+};
+
+//Result of one WeatherStatsEngine::compute call. Only the statistics named in 'computed' are filled in
+struct WeatherStats {
+    unsigned int computed = 0;
+    size_t count = 0;
+    double mean = 0;
+    double sd = 0;
+    float min = INFINITY;
+    float max = -INFINITY;
+    Moments moments; //everything merged from the partials, for combining with results over other data
+
+    int kernel_time = 0; //ns, from the profiling events
+    int transfer_time = 0; //ns
+    double host_time = 0; //ms, wall clock for the whole call including any setup
+};
+
+//Long lived owner of everything needed to compute the statistics: the context, one profiling queue, the built
+//...program, every kernel (created the first time it is used, then reused), a pool of device buffers and the
+//...resident dataset. Setup is paid once, so each compute() after the first is just the launches and a small read
+class WeatherStatsEngine {
+public:
+    WeatherStatsEngine(cl::Context context, const std::string& kernel_path, size_t workgroupSize)
+        : context_(context), queue_(context, CL_QUEUE_PROFILING_ENABLE), buffers_(context), workgroupSize_(workgroupSize) {
+        AddSources(sources_, kernel_path);
+        if (workgroupSize_ > 2048)
+            throw std::runtime_error("The reduction kernels support work-groups of at most 2048 work-items");
+        device_ = context_.getInfo<CL_CONTEXT_DEVICES>()[0];
+        compute_units_ = device_.getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>();
+        local_mem_size_ = (size_t)device_.getInfo<CL_DEVICE_LOCAL_MEM_SIZE>();
+
+        //use the best reduction path the device reports, dropping to the next one if its build fails anyway
+        //...(a driver claiming a feature its compiler can't handle). The tree always builds, or the error is real
+        for (ReducePath path : { REDUCE_WORK_GROUP, REDUCE_SUB_GROUP, REDUCE_TREE }) {
+            if (!supports(path))
+                continue;
+            try {
+                program_ = buildProgram(path);
+                reduce_path_ = path;
+                break;
+            }
+            catch (const cl::Error&) {
+                if (path == REDUCE_TREE)
+                    throw;
+                std::cout << "Build with " << reducePathName(path) << " failed, falling back" << std::endl;
+            }
+        }
+        std::cout << "Work-group reductions: " << reducePathName(reduce_path_) << std::endl;
+    }
+
+    //Whether the device claims what 'path' needs: OpenCL C 2.0 or later for the work-group built-ins (optional again
+    //...in 3.0, which the kernel source checks), cl_khr_subgroups for the sub-group ones
+    bool supports(ReducePath path) const {
+        switch (path) {
+        case REDUCE_WORK_GROUP:
+            return openclCVersion(device_) >= 20;
+        case REDUCE_SUB_GROUP:
+            return device_.getInfo<CL_DEVICE_EXTENSIONS>().find("cl_khr_subgroups") != std::string::npos;
+        default:
+            return true;
+        }
+    }
+
+    //Build a fresh copy of the kernels for one reduction path. The kernels are always compiled for this work-group
+    //...size (LOCAL_REDUCE unrolls its tree for it) and exact sums use 64 bit atomics when the device has them (see
+    //...reduce_fixed). Throws cl::Error if the build fails, after printing the log for the tree, which has no fallback
+    cl::Program buildProgram(ReducePath path) {
+        cl::Program program(context_, sources_);
+        std::string build_options = "-DWG_SIZE=" + std::to_string(workgroupSize_);
+        if (hasInt64Atomics(device_))
+            build_options += " -DINT64_ATOMICS";
+        int c_version = openclCVersion(device_);
+        if (path != REDUCE_TREE && c_version >= 20)
+            build_options += c_version >= 30 ? " -cl-std=CL3.0" : " -cl-std=CL2.0";
+        if (path == REDUCE_WORK_GROUP)
+            build_options += " -DWORK_GROUP_REDUCE";
+        else if (path == REDUCE_SUB_GROUP)
+            build_options += " -DSUB_GROUP_REDUCE";
+
+        //build and debug the kernel code
+        try {
+            program.build(build_options.c_str());
+        }
+        catch (const cl::Error&) {
+            if (path == REDUCE_TREE) {
+                std::cout << "Build Status: " << program.getBuildInfo<CL_PROGRAM_BUILD_STATUS>(device_) << std::endl;
+                std::cout << "Build Options:\t" << program.getBuildInfo<CL_PROGRAM_BUILD_OPTIONS>(device_) << std::endl;
+                std::cout << "Build Log:\t " << program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(device_) << std::endl;
+            }
+            throw;
+        }
+        return program;
+    }
+
+    //copy the temperatures to the device once, every compute() reads this copy
+    void upload(const float* values, size_t count) {
+        dataset_.reset(new DeviceDataset(context_, queue_, values, count));
+    }
+
+    DeviceDataset& dataset() { return *dataset_; }
+
+    cl::Kernel& kernel(const std::string& name) {
+        auto found = kernels_.find(name);
+        if (found == kernels_.end())
+            found = kernels_.insert(std::make_pair(name, cl::Kernel(program_, name.c_str()))).first;
+        return found->second;
+    }
+
+    //Compute the requested statistics (WeatherStat flags) of the resident dataset. All of them come from a single
+    //...pass of moments_fused, so asking for more of them costs nothing extra
+    WeatherStats compute(unsigned int stats = STAT_ALL) {
+        auto start = std::chrono::high_resolution_clock::now();
+        WeatherStats result;
+        if (!stats || !dataset_)
+            return result;
+
+        size_t vector_elements = dataset_->size();
+        size_t groups = stridedGroups(vector_elements, 1, "moments_fused");
+        partials_.resize(groups);
+        size_t output_size = groups * sizeof(MomentsPartial);
+        cl::Buffer buffer_Partials = buffers_.acquire(output_size);
+
+        cl::Kernel& kernel_moments = kernel("moments_fused");
+        kernel_moments.setArg(0, dataset_->temperatures());
+        kernel_moments.setArg(1, (cl_ulong)vector_elements);
+        kernel_moments.setArg(2, buffer_Partials);
+        kernel_moments.setArg(3, cl::Local(workgroupSize_ * sizeof(MomentsPartial)));
+
+        cl::Event kernel_event;
+        queue_.enqueueNDRangeKernel(kernel_moments, cl::NullRange, cl::NDRange(groups * workgroupSize_), cl::NDRange(workgroupSize_), NULL, &kernel_event);
+
+        cl::Event read_event;
+        queue_.enqueueReadBuffer(buffer_Partials, CL_TRUE, 0, output_size, &partials_[0], NULL, &read_event);
+        buffers_.release(buffer_Partials);
+
+        Moments moments;
+        for (const MomentsPartial& partial : partials_)
+            moments.merge(partial);
+
+        result.computed = stats;
+        result.count = (size_t)moments.count;
+        result.moments = moments;
+        if (stats & STAT_MEAN)
+            result.mean = moments.mean;
+        if (stats & STAT_SD)
+            result.sd = moments.sd();
+        if (stats & STAT_MIN)
+            result.min = moments.min;
+        if (stats & STAT_MAX)
+            result.max = moments.max;
+
+        result.kernel_time = (int)(kernel_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - kernel_event.getProfilingInfo<CL_PROFILING_COMMAND_START>());
+        result.transfer_time = (int)(read_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - read_event.getProfilingInfo<CL_PROFILING_COMMAND_START>());
+        result.host_time = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        return result;
+    }
+
+    //Work-groups to launch for a grid-stride kernel over 'elements' values where each work-item loads 'vector_width'
+    //...values at a time. Enough groups to keep every compute unit busy, but never more than the data can fill, so
+    //...large inputs are covered by each work-item looping rather than by a bigger launch. How many groups each
+    //...compute unit gets (and so how many elements each work-item handles) can be tuned per kernel
+    size_t stridedGroups(size_t elements, size_t vector_width = 1, const std::string& kernel_name = "") const {
+        size_t per_group = workgroupSize_ * vector_width;
+        size_t device_groups = std::min(STRIDED_MAX_GROUPS, std::max((size_t)1, compute_units_ * groupsPerComputeUnit(kernel_name)));
+        return std::max((size_t)1, std::min(device_groups, (elements + per_group - 1) / per_group));
+    }
+
+    size_t groupsPerComputeUnit(const std::string& kernel_name) const {
+        auto found = groups_per_compute_unit_.find(kernel_name);
+        return found == groups_per_compute_unit_.end() ? GROUPS_PER_COMPUTE_UNIT : found->second;
+    }
+
+    void setGroupsPerComputeUnit(const std::string& kernel_name, size_t groups) {
+        groups_per_compute_unit_[kernel_name] = std::max((size_t)1, groups);
+    }
+
+    //Multi-pass reduction driver. kernel_name is a work-group reduction with the signature
+    //...(global const float* in, int N, global float* out, local float* scratch) that writes one value per work-group.
+    //Each pass shrinks the data by the work-group size, reading from the previous pass's output: two pooled device
+    //...buffers are swapped between passes, so nothing is allocated per pass and nothing leaves the device until
+    //...at most hostFinishThreshold() values remain. Those are read back and returned for the host to finish.
+    //A non-zero vector_width marks a grid-stride kernel (the _vec kernels) loading that many values per step: its
+    //...launch is sized by stridedGroups() instead of one work-item per value, so one pass usually suffices.
+    //Works for any input size and any work-group size of 2 or more. The returned vector is reused by the next call
+    const std::vector<float>& reduce(const std::string& kernel_name, const cl::Buffer& input, size_t elements,
+        int& Kernel_time, int& Total_mem_time, int& Overall_time, size_t vector_width = 0) {
+        if (workgroupSize_ < 2)
+            throw std::runtime_error("Multi-pass reduction needs a work-group size of at least 2");
+        size_t threshold = hostFinishThreshold();
+        cl::Kernel& kernel_reduce = kernel(kernel_name);
+
+        auto groups_for = [this, vector_width, &kernel_name](size_t n) {
+            return vector_width ? stridedGroups(n, vector_width, kernel_name) : (n + workgroupSize_ - 1) / workgroupSize_;
+        };
+        cl::Buffer ping_pong[2] = {
+            buffers_.acquire(std::max((size_t)1, groups_for(elements)) * sizeof(float)),
+            buffers_.acquire(std::max((size_t)1, groups_for(groups_for(elements))) * sizeof(float))
+        };
+
+        pass_events_.clear();
+        const cl::Buffer* in = &input;
+        size_t n = elements;
+        for (int pass = 0; n > threshold; pass++) {
+            size_t groups = groups_for(n);
+            cl::Buffer& out = ping_pong[pass % 2];
+            kernel_reduce.setArg(0, *in);
+            if (vector_width)
+                kernel_reduce.setArg(1, (cl_ulong)n); //the _vec kernels take a ulong count
+            else
+                kernel_reduce.setArg(1, (int)n);
+            kernel_reduce.setArg(2, out);
+            kernel_reduce.setArg(3, cl::Local(workgroupSize_ * sizeof(float)));
+
+            pass_events_.push_back(cl::Event());
+            queue_.enqueueNDRangeKernel(kernel_reduce, cl::NullRange, cl::NDRange(groups * workgroupSize_), cl::NDRange(workgroupSize_), NULL, &pass_events_.back());
+            in = &out;
+            n = groups;
+        }
+
+        host_result_.resize(n);
+        if (n) {
+            cl::Event read_event;
+            queue_.enqueueReadBuffer(*in, CL_TRUE, 0, n * sizeof(float), &host_result_[0], NULL, &read_event);
+            int read_time = (int)(read_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - read_event.getProfilingInfo<CL_PROFILING_COMMAND_START>());
+            Total_mem_time += read_time;
+            Overall_time += read_time;
+        }
+        for (cl::Event& pass_event : pass_events_) {
+            pass_event.wait();
+            int pass_time = (int)(pass_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - pass_event.getProfilingInfo<CL_PROFILING_COMMAND_START>());
+            Kernel_time += pass_time;
+            Overall_time += pass_time;
+        }
+
+        buffers_.release(ping_pong[0]);
+        buffers_.release(ping_pong[1]);
+        return host_result_;
+    }
+
+    //Count how often each value (in tenths of a degree) occurs in 'input'. min and max must bound the data - the
+    //...dataset's own extremes - so there is one bin per tenth between them. The work-groups count in local memory
+    //...when the histogram fits there, and straight into global memory otherwise
+    TemperatureHistogram histogram(const cl::Buffer& input, size_t count, float min, float max,
+        int& Kernel_time, int& Total_mem_time, int& Overall_time) {
+        TemperatureHistogram result;
+        if (!count)
+            return result;
+        result.min_tenths = (int)lrintf(min * 10);
+        long long bins = (long long)lrintf(max * 10) - result.min_tenths + 1;
+        if (bins < 1 || bins > (1 << 24))
+            throw std::runtime_error("Temperature range is too wide for a histogram");
+        result.counts.resize((size_t)bins);
+        result.total = count;
+        size_t histogram_size = (size_t)bins * sizeof(cl_uint);
+
+        cl::Buffer buffer_Histogram = buffers_.acquire(histogram_size);
+        cl::Event fill_event;
+        queue_.enqueueFillBuffer(buffer_Histogram, (cl_uint)0, 0, histogram_size, NULL, &fill_event);
+
+        bool privatised = histogram_size <= local_mem_size_;
+        cl::Kernel& kernel_histogram = kernel(privatised ? "histogram_tenths" : "histogram_tenths_global");
+        kernel_histogram.setArg(0, input);
+        kernel_histogram.setArg(1, (cl_ulong)count);
+        kernel_histogram.setArg(2, (cl_int)result.min_tenths);
+        kernel_histogram.setArg(3, (cl_uint)bins);
+        kernel_histogram.setArg(4, buffer_Histogram);
+        if (privatised)
+            kernel_histogram.setArg(5, cl::Local(histogram_size));
+
+        size_t groups = stridedGroups(count, 1, "histogram_tenths");
+        cl::Event kernel_event;
+        queue_.enqueueNDRangeKernel(kernel_histogram, cl::NullRange, cl::NDRange(groups * workgroupSize_), cl::NDRange(workgroupSize_), NULL, &kernel_event);
+
+        cl::Event read_event;
+        queue_.enqueueReadBuffer(buffer_Histogram, CL_TRUE, 0, histogram_size, &result.counts[0], NULL, &read_event);
+        buffers_.release(buffer_Histogram);
+
+        int kernel_time = (int)(kernel_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - kernel_event.getProfilingInfo<CL_PROFILING_COMMAND_START>());
+        int mem_time = (int)(fill_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - fill_event.getProfilingInfo<CL_PROFILING_COMMAND_START>())
+            + (int)(read_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - read_event.getProfilingInfo<CL_PROFILING_COMMAND_START>());
+        Kernel_time += kernel_time;
+        Total_mem_time += mem_time;
+        Overall_time += kernel_time + mem_time;
+        return result;
+    }
+
+    //Exact k-th smallest (from 0) of 'count' floats in 'input', by radix select (see kernels.cl). Every pass counts
+    //...the next 8 bits of the values still in the running, keeps the bucket that holds k and compacts it into a
+    //...smaller pooled buffer, so each pass reads less than the one before. Once at most hostFinishThreshold() values
+    //...are left they are read back and finished on the host
+    float select(const cl::Buffer& input, size_t count, size_t k, int& Kernel_time, int& Total_mem_time, int& Overall_time) {
+        if (k >= count)
+            throw std::out_of_range("select: k is past the end of the data");
+        size_t threshold = hostFinishThreshold();
+        cl::Kernel& kernel_histogram = kernel("radix_select_histogram");
+        cl::Kernel& kernel_compact = kernel("radix_select_compact");
+        cl::Buffer buffer_Histogram = buffers_.acquire(256 * sizeof(cl_uint));
+        cl::Buffer buffer_Count = buffers_.acquire(sizeof(cl_uint));
+        std::vector<cl::Buffer> candidates;
+        candidates.reserve(4); //'in' points into it, so it must never reallocate
+        std::vector<cl::Event> mem_events;
+        cl_uint histogram[256];
+
+        pass_events_.clear();
+        const cl::Buffer* in = &input;
+        size_t n = count;
+        cl_uint prefix = 0, prefix_mask = 0;
+        float result = 0.0f;
+        for (int shift = 24; ; shift -= 8) {
+            //every value in 'in' matches the prefix, so once there are few enough of them the host finishes
+            if (n <= threshold) {
+                host_result_.resize(n);
+                mem_events.push_back(cl::Event());
+                queue_.enqueueReadBuffer(*in, CL_TRUE, 0, n * sizeof(float), &host_result_[0], NULL, &mem_events.back());
+                std::nth_element(host_result_.begin(), host_result_.begin() + k, host_result_.end());
+                result = host_result_[k];
+                break;
+            }
+
+            mem_events.push_back(cl::Event());
+            queue_.enqueueFillBuffer(buffer_Histogram, (cl_uint)0, 0, 256 * sizeof(cl_uint), NULL, &mem_events.back());
+            kernel_histogram.setArg(0, *in);
+            kernel_histogram.setArg(1, (cl_ulong)n);
+            kernel_histogram.setArg(2, prefix);
+            kernel_histogram.setArg(3, prefix_mask);
+            kernel_histogram.setArg(4, (cl_uint)shift);
+            kernel_histogram.setArg(5, buffer_Histogram);
+            kernel_histogram.setArg(6, cl::Local(256 * sizeof(cl_uint)));
+            size_t groups = stridedGroups(n, 1, "radix_select_histogram");
+            pass_events_.push_back(cl::Event());
+            queue_.enqueueNDRangeKernel(kernel_histogram, cl::NullRange, cl::NDRange(groups * workgroupSize_), cl::NDRange(workgroupSize_), NULL, &pass_events_.back());
+            mem_events.push_back(cl::Event());
+            queue_.enqueueReadBuffer(buffer_Histogram, CL_TRUE, 0, 256 * sizeof(cl_uint), histogram, NULL, &mem_events.back());
+
+            //the bucket holding the k-th value, and k's position inside it
+            cl_uint digit = 0;
+            while (histogram[digit] <= k)
+                k -= histogram[digit++];
+            size_t bucket = histogram[digit];
+            prefix |= digit << shift;
+            prefix_mask |= 0xFFu << shift;
+            if (shift == 0) {
+                //all 32 bits are known, every value left is this one
+                cl_uint bits = (prefix & 0x80000000u) ? prefix ^ 0x80000000u : ~prefix;
+                memcpy(&result, &bits, sizeof(result));
+                break;
+            }
+            if (bucket == n)
+                continue; //nothing to drop, the next pass can read the same buffer
+
+            candidates.push_back(buffers_.acquire(bucket * sizeof(float)));
+            mem_events.push_back(cl::Event());
+            queue_.enqueueFillBuffer(buffer_Count, (cl_uint)0, 0, sizeof(cl_uint), NULL, &mem_events.back());
+            kernel_compact.setArg(0, *in);
+            kernel_compact.setArg(1, (cl_ulong)n);
+            kernel_compact.setArg(2, prefix);
+            kernel_compact.setArg(3, prefix_mask);
+            kernel_compact.setArg(4, candidates.back());
+            kernel_compact.setArg(5, buffer_Count);
+            groups = stridedGroups(n, 1, "radix_select_compact");
+            pass_events_.push_back(cl::Event());
+            queue_.enqueueNDRangeKernel(kernel_compact, cl::NullRange, cl::NDRange(groups * workgroupSize_), cl::NDRange(workgroupSize_), NULL, &pass_events_.back());
+            in = &candidates.back();
+            n = bucket;
+        }
+
+        for (cl::Event& mem_event : mem_events) {
+            mem_event.wait();
+            int mem_time = (int)(mem_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - mem_event.getProfilingInfo<CL_PROFILING_COMMAND_START>());
+            Total_mem_time += mem_time;
+            Overall_time += mem_time;
+        }
+        for (cl::Event& pass_event : pass_events_) {
+            pass_event.wait();
+            int pass_time = (int)(pass_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - pass_event.getProfilingInfo<CL_PROFILING_COMMAND_START>());
+            Kernel_time += pass_time;
+            Overall_time += pass_time;
+        }
+        for (cl::Buffer& candidate : candidates)
+            buffers_.release(candidate);
+        buffers_.release(buffer_Histogram);
+        buffers_.release(buffer_Count);
+        return result;
+    }
+
+    //Exact q-th quantile of any column on the device (the resident dataset, a map output...), interpolating between
+    //...the two nearest ranks like the sort and the histogram do. Costs one or two radix selects, never a sort
+    float quantile(const cl::Buffer& input, size_t count, double q, int& Kernel_time, int& Total_mem_time, int& Overall_time) {
+        if (!count)
+            return 0.0f;
+        double rank = std::min(std::max(q, 0.0), 1.0) * (count - 1);
+        size_t lower = (size_t)rank;
+        float lower_value = select(input, count, lower, Kernel_time, Total_mem_time, Overall_time);
+        if (rank == lower || lower + 1 >= count)
+            return lower_value;
+        float upper_value = select(input, count, lower + 1, Kernel_time, Total_mem_time, Overall_time);
+        return (float)(lower_value + (rank - lower) * (upper_value - lower_value));
+    }
+
+    float quantile(const cl::Buffer& input, size_t count, double q) {
+        int Kernel_time = 0, Total_mem_time = 0, Overall_time = 0;
+        return quantile(input, count, q, Kernel_time, Total_mem_time, Overall_time);
+    }
+
+    //Sort 'count' floats from 'input' on the device (multi-launch bitonic sort, see kernels.cl). Returns a pooled
+    //...buffer holding them in ascending order, followed by +infinity padding up to the next power of two (at least
+    //...one block of 2 * work-group size). Hand it back with buffers().release() when done with it.
+    //The input is copied, not sorted in place, so the resident dataset keeps its order
+    cl::Buffer sort(const cl::Buffer& input, size_t count, int& Kernel_time, int& Total_mem_time, int& Overall_time) {
+        if (workgroupSize_ & (workgroupSize_ - 1))
+            throw std::runtime_error("The bitonic sort needs a power of two work-group size");
+        size_t block = 2 * workgroupSize_;
+        size_t padded = block;
+        while (padded < count)
+            padded *= 2;
+
+        cl::Buffer sorted = buffers_.acquire(padded * sizeof(float));
+        std::vector<cl::Event> copy_events;
+        if (count) {
+            copy_events.push_back(cl::Event());
+            queue_.enqueueCopyBuffer(input, sorted, 0, 0, count * sizeof(float), NULL, &copy_events.back());
+        }
+        if (padded > count) {
+            copy_events.push_back(cl::Event());
+            queue_.enqueueFillBuffer(sorted, INFINITY, count * sizeof(float), (padded - count) * sizeof(float), NULL, &copy_events.back());
+        }
+
+        cl::Kernel& kernel_sort = kernel("bitonic_sort_local");
+        cl::Kernel& kernel_merge_global = kernel("bitonic_merge_global");
+        cl::Kernel& kernel_merge_local = kernel("bitonic_merge_local");
+        cl::NDRange global(padded / 2), local(workgroupSize_);
+
+        pass_events_.clear();
+        kernel_sort.setArg(0, sorted);
+        kernel_sort.setArg(1, cl::Local(block * sizeof(float)));
+        pass_events_.push_back(cl::Event());
+        queue_.enqueueNDRangeKernel(kernel_sort, cl::NullRange, global, local, NULL, &pass_events_.back());
+        for (size_t k = 2 * block; k <= padded; k *= 2) {
+            for (size_t j = k / 2; j >= block; j /= 2) {
+                kernel_merge_global.setArg(0, sorted);
+                kernel_merge_global.setArg(1, (cl_uint)k);
+                kernel_merge_global.setArg(2, (cl_uint)j);
+                pass_events_.push_back(cl::Event());
+                queue_.enqueueNDRangeKernel(kernel_merge_global, cl::NullRange, global, local, NULL, &pass_events_.back());
+            }
+            kernel_merge_local.setArg(0, sorted);
+            kernel_merge_local.setArg(1, (cl_uint)k);
+            kernel_merge_local.setArg(2, cl::Local(block * sizeof(float)));
+            pass_events_.push_back(cl::Event());
+            queue_.enqueueNDRangeKernel(kernel_merge_local, cl::NullRange, global, local, NULL, &pass_events_.back());
+        }
+
+        for (cl::Event& copy_event : copy_events) {
+            copy_event.wait();
+            int copy_time = (int)(copy_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - copy_event.getProfilingInfo<CL_PROFILING_COMMAND_START>());
+            Total_mem_time += copy_time;
+            Overall_time += copy_time;
+        }
+        for (cl::Event& pass_event : pass_events_) {
+            pass_event.wait();
+            int pass_time = (int)(pass_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - pass_event.getProfilingInfo<CL_PROFILING_COMMAND_START>());
+            Kernel_time += pass_time;
+            Overall_time += pass_time;
+        }
+        return sorted;
+    }
+
+    //Number of values below which another reduction pass costs more than finishing on the host. Measured once:
+    //...the round trip of a one work-group launch plus a small read (the fixed cost of a pass) divided by the host's
+    //...time per element for a linear scan
+    size_t hostFinishThreshold() {
+        if (host_threshold_)
+            return host_threshold_;
+
+        const int runs = 5;
+        cl::Buffer small = buffers_.acquire(workgroupSize_ * sizeof(float));
+        cl::Buffer result = buffers_.acquire(sizeof(float));
+        queue_.enqueueFillBuffer(small, 0.0f, 0, workgroupSize_ * sizeof(float));
+        cl::Kernel& kernel_min = kernel("min_reduce");
+        kernel_min.setArg(0, small);
+        kernel_min.setArg(1, (int)workgroupSize_);
+        kernel_min.setArg(2, result);
+        kernel_min.setArg(3, cl::Local(workgroupSize_ * sizeof(float)));
+        float value;
+        double pass_ns = 0;
+        for (int r = 0; r <= runs; r++) {
+            auto start = std::chrono::high_resolution_clock::now();
+            queue_.enqueueNDRangeKernel(kernel_min, cl::NullRange, cl::NDRange(workgroupSize_), cl::NDRange(workgroupSize_));
+            queue_.enqueueReadBuffer(result, CL_TRUE, 0, sizeof(float), &value);
+            if (r) //the first run is a warm up
+                pass_ns += std::chrono::duration<double, std::nano>(std::chrono::high_resolution_clock::now() - start).count() / runs;
+        }
+        buffers_.release(small);
+        buffers_.release(result);
+
+        std::vector<float> values(1 << 20, 1.0f);
+        auto start = std::chrono::high_resolution_clock::now();
+        volatile float host_min = *std::min_element(values.begin(), values.end());
+        (void)host_min;
+        double element_ns = std::chrono::duration<double, std::nano>(std::chrono::high_resolution_clock::now() - start).count() / values.size();
+
+        host_threshold_ = (size_t)std::min(std::max(pass_ns / std::max(element_ns, 1e-3), (double)workgroupSize_), (double)(1 << 22));
+        std::cout << "Measured host-finish threshold: " << host_threshold_ << " values (pass round trip " << pass_ns / 1000
+            << " us, host " << element_ns << " ns per value)" << std::endl;
+        return host_threshold_;
+    }
+
+    //use a known threshold (a tuning profile's) instead of measuring one, 0 measures again on next use
+    void setHostFinishThreshold(size_t threshold) {
+        host_threshold_ = threshold ? std::max(threshold, (size_t)1) : 0;
+    }
+
+    cl::Context& context() { return context_; }
+    cl::Program& program() { return program_; }
+    //Queues for running independent statistics side by side: one out-of-order queue when the device supports it (the
+    //...commands are then ordered only by their event wait lists), otherwise 'lanes' in-order queues, the first being
+    //...the engine's own. All are profiling queues on the engine's device, so their event timestamps can be compared
+    std::vector<cl::CommandQueue> concurrentQueues(size_t lanes) {
+        if (device_.getInfo<CL_DEVICE_QUEUE_PROPERTIES>() & CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE)
+            return std::vector<cl::CommandQueue>(1, cl::CommandQueue(context_, device_, CL_QUEUE_PROFILING_ENABLE | CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE));
+        std::vector<cl::CommandQueue> queues(1, queue_);
+        while (queues.size() < lanes)
+            queues.push_back(cl::CommandQueue(context_, device_, CL_QUEUE_PROFILING_ENABLE));
+        return queues;
+    }
+
+    cl::CommandQueue& queue() { return queue_; }
+    BufferPool& buffers() { return buffers_; }
+    size_t workgroupSize() const { return workgroupSize_; }
+    size_t computeUnits() const { return compute_units_; }
+    ReducePath reducePath() const { return reduce_path_; }
+
+private:
+    cl::Context context_;
+    cl::Device device_;
+    cl::CommandQueue queue_;
+    cl::Program::Sources sources_;
+    cl::Program program_;
+    ReducePath reduce_path_ = REDUCE_TREE;
+    BufferPool buffers_;
+    size_t workgroupSize_;
+    size_t compute_units_ = 1;
+    size_t local_mem_size_ = 0;
+    std::map<std::string, cl::Kernel> kernels_;
+    std::map<std::string, size_t> groups_per_compute_unit_; //tuned values, GROUPS_PER_COMPUTE_UNIT otherwise
+    std::unique_ptr<DeviceDataset> dataset_;
+    std::vector<MomentsPartial> partials_; //host side of the partials read, kept between calls
+    std::vector<float> host_result_; //last few values of a multi-pass reduce(), kept between calls
+    std::vector<cl::Event> pass_events_;
+    size_t host_threshold_ = 0;
+};
@@ -1,46 +1,292 @@
+//***Work-group reduction***
+//Every reduction kernel below finishes with LOCAL_REDUCE(T, scratch, lid, OP): each work-item has put its value of
+//...type T in scratch[lid], and afterwards scratch[0] holds the whole work-group's result. The host picks one of
+//...three implementations when it builds the program (WeatherStatsEngine checks the device's OpenCL C version and
+//...extensions, and falls back to the next one if a build fails):
+//  -DWORK_GROUP_REDUCE  OpenCL C 2.0 work_group_reduce_add/min/max, one built-in call for the whole work-group
+//  -DSUB_GROUP_REDUCE   cl_khr_subgroups sub_group_reduce_*, one result per sub-group in local memory, then the
+//                       first sub-group reduces those
+//  (neither)            the local memory tree below
+//Combinations without a built-in (merge_moments, merge_partial4) always use the tree.
+//
+//The tree uses sequential addressing. Work-item lid combines its slot with lid + half, so the work-items still
+//...active are always the lowest numbered ones (whole wavefronts drop out together instead of every other
+//...work-item idling), neighbouring work-items touch neighbouring local memory banks, and there is no modulo.
+//Only local memory is written between stages, so the barriers only fence local memory.
+//The stages are written out one by one (1024 down to 1), so there is no loop at all. The host builds the program
+//...with -DWG_SIZE=<work-group size>, which makes every stage's condition a compile time constant: the stages
+//...bigger than the work-group vanish and the kernels are compiled for exactly that size (REDUCE_ATTRIBUTES).
+//Without WG_SIZE the same code runs off get_local_size(0). The first stage's half is the largest power of two below
+//...the size, so work-groups that aren't a power of two (up to 2048) reduce correctly as well.
+//The last stages keep their barriers - OpenCL makes no promise that a wavefront runs in lockstep
+#ifdef WG_SIZE
+#define REDUCE_SIZE WG_SIZE
+#define REDUCE_ATTRIBUTES __attribute__((reqd_work_group_size(WG_SIZE, 1, 1)))
+#else
+#define REDUCE_SIZE get_local_size(0)
+#define REDUCE_ATTRIBUTES
+#endif
+
+#define REDUCE_ADD(a, b) ((a) + (b))
+
+#define REDUCE_STAGE(scratch, lid, OP, half) \
+	if (REDUCE_SIZE > (half)) { \
+		if ((lid) < (half) && (lid) + (half) < REDUCE_SIZE) \
+			scratch[lid] = OP(scratch[lid], scratch[(lid) + (half)]); \
+		barrier(CLK_LOCAL_MEM_FENCE); \
+	}
+
+#define TREE_REDUCE(scratch, lid, OP) \
+	REDUCE_STAGE(scratch, lid, OP, 1024) \
+	REDUCE_STAGE(scratch, lid, OP, 512) \
+	REDUCE_STAGE(scratch, lid, OP, 256) \
+	REDUCE_STAGE(scratch, lid, OP, 128) \
+	REDUCE_STAGE(scratch, lid, OP, 64) \
+	REDUCE_STAGE(scratch, lid, OP, 32) \
+	REDUCE_STAGE(scratch, lid, OP, 16) \
+	REDUCE_STAGE(scratch, lid, OP, 8) \
+	REDUCE_STAGE(scratch, lid, OP, 4) \
+	REDUCE_STAGE(scratch, lid, OP, 2) \
+	REDUCE_STAGE(scratch, lid, OP, 1)
+
+//BUILTIN_REDUCE(T, scratch, lid, KIND, ARG_T, OP): reduce with the add/min/max (KIND) built-in, called on ARG_T
+//...since the built-ins have no short overloads
+#if defined(WORK_GROUP_REDUCE)
+#if __OPENCL_C_VERSION__ >= 300 && !defined(__opencl_c_work_group_collective_functions)
+#error "work-group collective functions are optional in OpenCL C 3.0 and this device doesn't have them"
+#endif
+//every work-item gets the result and writes it to its own slot, so no barrier is needed before scratch[0] is read
+#define BUILTIN_REDUCE(T, scratch, lid, KIND, ARG_T, OP) \
+	scratch[lid] = (T)work_group_reduce_##KIND((ARG_T)scratch[lid])
+
+#elif defined(SUB_GROUP_REDUCE)
+#pragma OPENCL EXTENSION cl_khr_subgroups : enable
+//lanes of the first sub-group past the number of sub-groups contribute the identity (0) for add, and any real value for min/max
+#define SUB_GROUP_IDLE_add(T, scratch) ((T)0)
+#define SUB_GROUP_IDLE_min(T, scratch) scratch[0]
+#define SUB_GROUP_IDLE_max(T, scratch) scratch[0]
+#define BUILTIN_REDUCE(T, scratch, lid, KIND, ARG_T, OP) \
+	{ \
+		T sub_group_value = (T)sub_group_reduce_##KIND((ARG_T)scratch[lid]); \
+		barrier(CLK_LOCAL_MEM_FENCE); \
+		if (get_sub_group_local_id() == 0) \
+			scratch[get_sub_group_id()] = sub_group_value; \
+		barrier(CLK_LOCAL_MEM_FENCE); \
+		if (get_sub_group_id() == 0) { \
+			uint lane = get_sub_group_local_id(); \
+			uint sub_groups = get_num_sub_groups(); \
+			T lane_value = (lane < sub_groups) ? scratch[lane] : SUB_GROUP_IDLE_##KIND(T, scratch); \
+			for (uint i = lane + get_sub_group_size(); i < sub_groups; i += get_sub_group_size()) \
+				lane_value = OP(lane_value, scratch[i]); \
+			lane_value = (T)sub_group_reduce_##KIND((ARG_T)lane_value); \
+			if (lane == 0) \
+				scratch[0] = lane_value; \
+		} \
+		barrier(CLK_LOCAL_MEM_FENCE); \
+	}
+
+#else
+#define BUILTIN_REDUCE(T, scratch, lid, KIND, ARG_T, OP) TREE_REDUCE(scratch, lid, OP)
+#endif
+
+#define LOCAL_REDUCE(T, scratch, lid, OP) LOCAL_REDUCE_##OP(T, scratch, lid, OP)
+#define LOCAL_REDUCE_REDUCE_ADD(T, scratch, lid, OP) BUILTIN_REDUCE(T, scratch, lid, add, T, OP)
+#define LOCAL_REDUCE_fmin(T, scratch, lid, OP) BUILTIN_REDUCE(T, scratch, lid, min, float, OP)
+#define LOCAL_REDUCE_fmax(T, scratch, lid, OP) BUILTIN_REDUCE(T, scratch, lid, max, float, OP)
+#define LOCAL_REDUCE_min(T, scratch, lid, OP) BUILTIN_REDUCE(T, scratch, lid, min, int, OP)
+#define LOCAL_REDUCE_max(T, scratch, lid, OP) BUILTIN_REDUCE(T, scratch, lid, max, int, OP)
+#define LOCAL_REDUCE_merge_moments(T, scratch, lid, OP) TREE_REDUCE(scratch, lid, OP)
+#define LOCAL_REDUCE_merge_partial4(T, scratch, lid, OP) TREE_REDUCE(scratch, lid, OP)
+
 //***Mean***
-kernel void reduce_atomic_single_array(global const float* Temperatures, global int* Output, local float* localCopy) {
+#ifdef INT64_ATOMICS
+#pragma OPENCL EXTENSION cl_khr_int64_base_atomics : enable
+#endif
+//Output step shared by the fixed-point sums: the work-group's total of every work-item's 'sum' goes to Output as
+//...described for reduce_fixed
+void fixed_sum_output(long sum, local long* localCopy, global long* Output) {
+	size_t lid = get_local_id(0);
+	localCopy[lid] = sum;
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	LOCAL_REDUCE(long, localCopy, lid, REDUCE_ADD);
+
+	if (!lid) {
+#ifdef INT64_ATOMICS
+		atom_add(&Output[0], localCopy[0]);
+#else
+		Output[get_group_id(0)] = localCopy[0];
+#endif
+	}
+}
+
+//Exact fixed-point sum. Every value is scaled (x10 for temperatures, which have one decimal place) and rounded to a long,
+//...so the sum is a whole number that can't drift or overflow on any realistic dataset. Each work-item strides over the
+//...input by the global size, so one launch of a fixed number of work-groups covers any N and no padding is needed.
+//Built with -DINT64_ATOMICS (device has cl_khr_int64_base_atomics) every group adds its sum into Output[0],
+//...otherwise each group writes its own partial to Output[group] and the host adds them up
+kernel REDUCE_ATTRIBUTES void reduce_fixed(global const float* Values, ulong N, float scale, global long* Output, local long* localCopy) {
+	long sum = 0;
+	for (size_t i = get_global_id(0); i < N; i += get_global_size(0)) {
+		sum += convert_long_rte(Values[i] * scale);
+	}
+	fixed_sum_output(sum, localCopy, Output);
+}
+
+//***Fused moments (mean, min, max, SD in one pass)***
+//Each work-item walks its share of the input with a grid stride, keeping a running count, mean and M2 (sum of squared
+//...differences from the mean) with Welford's update, plus the min and max. The work-group then merges its work-items'
+//...results pairwise with Chan et al.'s formula and writes one partial, which the host merges the same way (Moments.h).
+//Every value is read from global memory once, and merging (count, mean, M2) keeps the variance stable where
+//...sum of squares minus squared sum would cancel
+typedef struct {
+	uint count;
+	float mean;
+	float m2;
+	float min;
+	float max;
+} Moments;
+
+Moments merge_moments(Moments a, Moments b) {
+	Moments r;
+	r.count = a.count + b.count;
+	r.min = fmin(a.min, b.min);
+	r.max = fmax(a.max, b.max);
+	if (r.count == 0) {
+		r.mean = 0.0f;
+		r.m2 = 0.0f;
+		return r;
+	}
+	float delta = b.mean - a.mean;
+	float weight_b = (float)b.count / (float)r.count;
+	r.mean = a.mean + delta * weight_b;
+	r.m2 = a.m2 + b.m2 + delta * delta * (float)a.count * weight_b;
+	return r;
+}
+
+kernel REDUCE_ATTRIBUTES void moments_fused(global const float* Values, ulong N, global Moments* Partials, local Moments* localCopy) {
+	size_t lid = get_local_id(0);
+
+	Moments m;
+	m.count = 0;
+	m.mean = 0.0f;
+	m.m2 = 0.0f;
+	m.min = INFINITY;
+	m.max = -INFINITY;
+	for (size_t i = get_global_id(0); i < N; i += get_global_size(0)) {
+		float x = Values[i];
+		m.count++;
+		float delta = x - m.mean;
+		m.mean += delta / (float)m.count;
+		m.m2 += delta * (x - m.mean);
+		m.min = fmin(m.min, x);
+		m.max = fmax(m.max, x);
+	}
+	localCopy[lid] = m;
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	LOCAL_REDUCE(Moments, localCopy, lid, merge_moments);
+
+	if (!lid) {
+		Partials[get_group_id(0)] = localCopy[0];
+	}
+}
+
+//***Min***
+kernel REDUCE_ATTRIBUTES void min_reduce(global const float* Temperatures, int N, global float* Output_min, local float* localCopy) {
 	int id = get_global_id(0);
 	int lid = get_local_id(0);
-	int N = get_local_size(0);
 
-	localCopy[lid] = Temperatures[id]; //create local copy for quicker accessing 
+	//N is the number of real values, the rest of the last group gets a value that can't win
+	localCopy[lid] = (id < N) ? Temperatures[id] : INFINITY; //create local copy for quicker accessing 
 
-	barrier(CLK_GLOBAL_MEM_FENCE); //ensure all threads copy
+	barrier(CLK_LOCAL_MEM_FENCE); //ensure all threads copy
 
-	for (int stride=1; stride<N; stride*=2) {
-		if ((lid % (stride*2) == 0)) {
-			localCopy[lid] += localCopy[lid+stride];
-		}
-		barrier(CLK_GLOBAL_MEM_FENCE);
+	LOCAL_REDUCE(float, localCopy, lid, fmin);
+
+	//copy the cache to output array
+	if (!lid) {
+		Output_min[get_group_id(0)] = localCopy[0]; //one result per work-group, whatever the work-group size
 	}
-	
+}
+
+//***Max***
+kernel REDUCE_ATTRIBUTES void max_reduce(global const float* Temperatures, int N, global float* Output_max, local float* localCopy) {
+	int id = get_global_id(0);
+	int lid = get_local_id(0);
+
+	//N is the number of real values, the rest of the last group gets a value that can't win
+	localCopy[lid] = (id < N) ? Temperatures[id] : -INFINITY; //create local copy for quicker accessing 
+
+	barrier(CLK_LOCAL_MEM_FENCE); //ensure all threads copy
+
+	LOCAL_REDUCE(float, localCopy, lid, fmax);
+
 	//copy the cache to output array
 	if (!lid) {
-		float intpart;
-		float fractpart = modf (localCopy[lid] , &intpart); // use modf function to extract the decimal value
-		int convertedInt = convert_int(localCopy[lid]); // convert the float value to int (remove everything after decimal point)
-		int convertedDesc = convert_int(fractpart*10); // multiply by 10 to turn the decimal point to a float > 0. Then convert to int. only multipled by 10 as only
-		//require one point of precision
+		Output_max[get_group_id(0)] = localCopy[0]; //one result per work-group, whatever the work-group size
+	}
+}
 
-		// add the two values to two seperate positions - one for the integer values and one for the decimal values
-		atomic_add(&Output[0],convertedInt);
-		atomic_add(&Output[1],convertedDesc);
+//***SD***
+kernel void sd_map(global const float* Temperatures, int N, global float* Output_sd, float mean){
+	int id = get_global_id(0);
+
+	//the global size is rounded up to the work-group size, only the first N work-items have a value
+	if (id < N) {
+		float meanSub = Temperatures[id] - mean;
+		Output_sd[id] = meanSub * meanSub;
 	}
 }
 
-//***Min***
-kernel void min_reduce(global const float* Temperatures, global float* Output_min, local float* localCopy){
+//Exact fixed-point sum of squares: each value is scaled and rounded as in reduce_fixed, and the square of that whole
+//...number is added. With reduce_fixed's sum of the same values the host gets the squared deviations from the mean out
+//...of two exact integers (fixed_squared_deviations in Host.cpp), so the mean doesn't have to be known first.
+//Temperatures x10 are a few thousand at most, so a square is a few million and the sum stays far inside a long.
+//Output works as for reduce_fixed
+kernel REDUCE_ATTRIBUTES void sumsq_fixed(global const float* Values, ulong N, float scale, global long* Output, local long* localCopy) {
+	long sum = 0;
+	for (size_t i = get_global_id(0); i < N; i += get_global_size(0)) {
+		long t = convert_long_rte(Values[i] * scale);
+		sum += t * t;
+	}
+	fixed_sum_output(sum, localCopy, Output);
+}
+
+kernel REDUCE_ATTRIBUTES void reduce(global const float* Temperatures, int N, global float* Output_reduce, local float* localCopy) {
+	int id = get_global_id(0);
+	int lid = get_local_id(0);
+
+	localCopy[lid] = (id < N) ? Temperatures[id] : 0.0f; //create local copy for quicker accessing, 0 past the end doesn't change the sum
+
+	barrier(CLK_LOCAL_MEM_FENCE); //ensure all threads copy
+
+	LOCAL_REDUCE(float, localCopy, lid, REDUCE_ADD);
+
+	//copy the cache to output array
+	if (!lid) {
+		//each work-group's sum goes to the slot for its group, so the output is the input divided by the work-group size
+		Output_reduce[get_group_id(0)] = localCopy[0];
+	}
+}
+
+//***Interleaved reductions (baseline)***
+//min_reduce and reduce as they were before LOCAL_REDUCE: interleaved addressing with a modulo per stage and global
+//...fences. Not used by the statistics, only kept so --bench-reduce can time the old loop against the new one
+kernel void min_reduce_interleaved(global const float* Temperatures, int N, global float* Output_min, local float* localCopy){
 	int id = get_global_id(0);
 	int lid = get_local_id(0);
-	int N = get_local_size(0);
+	int N_local = get_local_size(0);
 
-	localCopy[lid] = Temperatures[id]; //create local copy for quicker accessing 
+	//N is the number of real values, the rest of the last group gets a value that can't win
+	localCopy[lid] = (id < N) ? Temperatures[id] : INFINITY; //create local copy for quicker accessing 
 
 	barrier(CLK_GLOBAL_MEM_FENCE); //ensure all threads copy
 
-	for (int stride=1; stride<N; stride*=2) {
-		if ((lid % (stride*2) == 0) && ((lid + stride) < N)) {
+	for (int stride=1; stride<N_local; stride*=2) {
+		if ((lid % (stride*2) == 0) && ((lid + stride) < N_local)) {
 			if (localCopy[lid] > localCopy[lid+stride]){
 				localCopy[lid] = localCopy[lid+stride];
 			}
@@ -50,144 +296,432 @@ kernel void min_reduce(global const float* Temperatures, global float* Output_mi
 	
 	//copy the cache to output array
 	if (!lid) {
-		int idOffsetMultiplier = id/32;
-		Output_min[idOffsetMultiplier] = localCopy[lid];
+		Output_min[get_group_id(0)] = localCopy[lid]; //one result per work-group, whatever the work-group size
 	}
 
 }
 
-//***Max***
-kernel void max_reduce(global const float* Temperatures, global float* Output_max, local float* localCopy){
+kernel void reduce_interleaved(global const float* Temperatures, int N, global float* Output_reduce, local float* localCopy) {
 	int id = get_global_id(0);
 	int lid = get_local_id(0);
-	int N = get_local_size(0);
+	int N_local = get_local_size(0);
 
-	localCopy[lid] = Temperatures[id]; //create local copy for quicker accessing 
+	localCopy[lid] = (id < N) ? Temperatures[id] : 0.0f; //create local copy for quicker accessing, 0 past the end doesn't change the sum
 
 	barrier(CLK_GLOBAL_MEM_FENCE); //ensure all threads copy
 
-	for (int stride=1; stride<N; stride*=2) {
-		if ((lid % (stride*2) == 0) && ((lid + stride) < N)) {
-			if (localCopy[lid] < localCopy[lid+stride]){
-				localCopy[lid] = localCopy[lid+stride];
-			}
+	for (int stride=1; stride<N_local; stride*=2) {
+		if ((lid % (stride*2) == 0) && ((lid + stride) < N_local)) {
+			localCopy[lid] += localCopy[lid+stride];
 		}
 		barrier(CLK_GLOBAL_MEM_FENCE);
 	}
-	
+
 	//copy the cache to output array
 	if (!lid) {
-		int idOffsetMultiplier = id/32;
-		Output_max[idOffsetMultiplier] = localCopy[lid];
-	}
+		//each work-group's sum goes to the slot for its group, so the output is the input divided by the work-group size
+		Output_reduce[get_group_id(0)] = localCopy[lid];
+	}
 }
 
-//***SD***
-kernel void sd_map(global const float* Temperatures, global float* Output_sd, global float* Mean, local float* localCopy){
-	int id = get_global_id(0);
+//***Vectorised grid-stride reductions***
+//Each work-item reads many values instead of one: vload4 (float) / vload8 (short) in a loop that strides by the
+//...global size, so neighbouring work-items read neighbouring vectors. Only after that does the work-group combine
+//...its work-items in local memory. The launch is sized from the device's compute units rather than from N
+//...(see WeatherStatsEngine::stridedGroups), so the loads are bandwidth bound and not limited by launch latency.
+//The last N % 4 (or N % 8) values are picked up one at a time. Output is one value per work-group
+kernel REDUCE_ATTRIBUTES void min_reduce_vec(global const float* Temperatures, ulong N, global float* Output_min, local float* localCopy) {
+	size_t id = get_global_id(0);
 	int lid = get_local_id(0);
-	int N = get_local_size(0);
+	size_t stride_global = get_global_size(0);
 
-	localCopy[lid] = Temperatures[id]; //create local copy for quicker accessing 
-	float mean = Mean[0];
+	float4 acc = (float4)(INFINITY);
+	size_t N4 = N / 4;
+	for (size_t i = id; i < N4; i += stride_global) {
+		acc = fmin(acc, vload4(i, Temperatures));
+	}
+	float m = fmin(fmin(acc.x, acc.y), fmin(acc.z, acc.w));
+	for (size_t i = N4*4 + id; i < N; i += stride_global) {
+		m = fmin(m, Temperatures[i]);
+	}
+	localCopy[lid] = m;
 
-	barrier(CLK_GLOBAL_MEM_FENCE); //ensure all threads copy
+	barrier(CLK_LOCAL_MEM_FENCE);
 
-	float meanSub = localCopy[lid] - mean;
-	float val = pow(meanSub, 2);
-	Output_sd[id] = val;
+	LOCAL_REDUCE(float, localCopy, lid, fmin);
+
+	if (!lid) {
+		Output_min[get_group_id(0)] = localCopy[0];
+	}
 }
 
-kernel void reduce(global const float* Temperatures, global float* Output_reduce, local float* localCopy) {
-	int id = get_global_id(0);
+kernel REDUCE_ATTRIBUTES void max_reduce_vec(global const float* Temperatures, ulong N, global float* Output_max, local float* localCopy) {
+	size_t id = get_global_id(0);
 	int lid = get_local_id(0);
-	int N = get_local_size(0);
+	size_t stride_global = get_global_size(0);
 
-	localCopy[lid] = Temperatures[id]; //create local copy for quicker accessing 
+	float4 acc = (float4)(-INFINITY);
+	size_t N4 = N / 4;
+	for (size_t i = id; i < N4; i += stride_global) {
+		acc = fmax(acc, vload4(i, Temperatures));
+	}
+	float m = fmax(fmax(acc.x, acc.y), fmax(acc.z, acc.w));
+	for (size_t i = N4*4 + id; i < N; i += stride_global) {
+		m = fmax(m, Temperatures[i]);
+	}
+	localCopy[lid] = m;
 
-	barrier(CLK_GLOBAL_MEM_FENCE); //ensure all threads copy
+	barrier(CLK_LOCAL_MEM_FENCE);
 
-	for (int stride=1; stride<N; stride*=2) {
-		if ((lid % (stride*2) == 0)) {
-			localCopy[lid] += localCopy[lid+stride];
-		}
-		barrier(CLK_GLOBAL_MEM_FENCE);
+	LOCAL_REDUCE(float, localCopy, lid, fmax);
+
+	if (!lid) {
+		Output_max[get_group_id(0)] = localCopy[0];
 	}
+}
+
+kernel REDUCE_ATTRIBUTES void reduce_vec(global const float* Temperatures, ulong N, global float* Output_reduce, local float* localCopy) {
+	size_t id = get_global_id(0);
+	int lid = get_local_id(0);
+	size_t stride_global = get_global_size(0);
+
+	float4 acc = (float4)(0.0f);
+	size_t N4 = N / 4;
+	for (size_t i = id; i < N4; i += stride_global) {
+		acc += vload4(i, Temperatures);
+	}
+	float sum = (acc.x + acc.y) + (acc.z + acc.w);
+	for (size_t i = N4*4 + id; i < N; i += stride_global) {
+		sum += Temperatures[i];
+	}
+	localCopy[lid] = sum;
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	LOCAL_REDUCE(float, localCopy, lid, REDUCE_ADD);
+
+	if (!lid) {
+		Output_reduce[get_group_id(0)] = localCopy[0];
+	}
+}
+
+//int16 versions for the fixed point mode (tenths of a degree, half the bytes of a float), eight values per load. The launch does not grow with N, so one work-item's
+//...lanes can see any share of the dataset and the sums add up in long from the first load
+kernel REDUCE_ATTRIBUTES void min_reduce_dc_vec(global const short* Temperatures, ulong N, global short* Output_min, local short* localCopy) {
+	size_t id = get_global_id(0);
+	int lid = get_local_id(0);
+	size_t stride_global = get_global_size(0);
+
+	short8 acc = (short8)(SHRT_MAX);
+	size_t N8 = N / 8;
+	for (size_t i = id; i < N8; i += stride_global) {
+		acc = min(acc, vload8(i, Temperatures));
+	}
+	short4 m4 = min(acc.lo, acc.hi);
+	short m = min(min(m4.x, m4.y), min(m4.z, m4.w));
+	for (size_t i = N8*8 + id; i < N; i += stride_global) {
+		m = min(m, Temperatures[i]);
+	}
+	localCopy[lid] = m;
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	LOCAL_REDUCE(short, localCopy, lid, min);
 
-	//copy the cache to output array
 	if (!lid) {
-		//in order to store the results of each workgroup reduction in the output array and not overwrite it with each group...
-		//...an offsetmultiplier is needed. This value works out which group has just completed by dividing the global id by 32.
-		//It then places the result of the workgroup at that position in the output array.
-		//E.g. group 1 will have an offset = 32/32 = 1 and therefore be placed at index 1, group 2 will have offset = 64/32 = 2 and will be placed at index 2...
-		int idOffsetMultiplier = id/32;
-		Output_reduce[idOffsetMultiplier] = localCopy[lid];
+		Output_min[get_group_id(0)] = localCopy[0];
 	}
 }
 
-kernel void reduce_2(global const float* Temperatures, global int* Output_reduce, local float* localCopy) {
+kernel REDUCE_ATTRIBUTES void max_reduce_dc_vec(global const short* Temperatures, ulong N, global short* Output_max, local short* localCopy) {
+	size_t id = get_global_id(0);
+	int lid = get_local_id(0);
+	size_t stride_global = get_global_size(0);
+
+	short8 acc = (short8)(SHRT_MIN);
+	size_t N8 = N / 8;
+	for (size_t i = id; i < N8; i += stride_global) {
+		acc = max(acc, vload8(i, Temperatures));
+	}
+	short4 m4 = max(acc.lo, acc.hi);
+	short m = max(max(m4.x, m4.y), max(m4.z, m4.w));
+	for (size_t i = N8*8 + id; i < N; i += stride_global) {
+		m = max(m, Temperatures[i]);
+	}
+	localCopy[lid] = m;
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	LOCAL_REDUCE(short, localCopy, lid, max);
+
+	if (!lid) {
+		Output_max[get_group_id(0)] = localCopy[0];
+	}
+}
+
+kernel REDUCE_ATTRIBUTES void reduce_dc_vec(global const short* Temperatures, ulong N, global long* Output_reduce, local long* localCopy) {
+	size_t id = get_global_id(0);
+	int lid = get_local_id(0);
+	size_t stride_global = get_global_size(0);
+
+	long8 acc = (long8)(0);
+	size_t N8 = N / 8;
+	for (size_t i = id; i < N8; i += stride_global) {
+		acc += convert_long8(vload8(i, Temperatures));
+	}
+	long4 s4 = acc.lo + acc.hi;
+	long sum = (s4.x + s4.y) + (s4.z + s4.w);
+	for (size_t i = N8*8 + id; i < N; i += stride_global) {
+		sum += Temperatures[i];
+	}
+	localCopy[lid] = sum;
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	LOCAL_REDUCE(long, localCopy, lid, REDUCE_ADD);
+
+	if (!lid) {
+		Output_reduce[get_group_id(0)] = localCopy[0];
+	}
+}
+
+kernel REDUCE_ATTRIBUTES void reduce_sq_dc_vec(global const short* Temperatures, ulong N, global long* Output_reduce, local long* localCopy) {
+	size_t id = get_global_id(0);
+	int lid = get_local_id(0);
+	size_t stride_global = get_global_size(0);
+
+	//a short squared always fits an int, so the products are formed 8 wide in int and only the running sum is long
+	long8 acc = (long8)(0);
+	size_t N8 = N / 8;
+	for (size_t i = id; i < N8; i += stride_global) {
+		int8 t = convert_int8(vload8(i, Temperatures));
+		acc += convert_long8(t * t);
+	}
+	long4 s4 = acc.lo + acc.hi;
+	long sum = (s4.x + s4.y) + (s4.z + s4.w);
+	for (size_t i = N8*8 + id; i < N; i += stride_global) {
+		long t = Temperatures[i];
+		sum += t*t;
+	}
+	localCopy[lid] = sum;
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	LOCAL_REDUCE(long, localCopy, lid, REDUCE_ADD);
+
+	if (!lid) {
+		Output_reduce[get_group_id(0)] = localCopy[0];
+	}
+}
+
+//***Streaming partial moments***
+float4 merge_partial4(float4 a, float4 b) {
+	return (float4)(a.x + b.x, a.y + b.y, fmin(a.z, b.z), fmax(a.w, b.w));
+}
+
+
+//Reduces one chunk of the streamed dataset to a (sum, sum of squares, min, max) partial per work-group.
+//N is the number of real values in the chunk - the last group may be partly empty so its spare work-items
+//...contribute identity values instead of reading past the end
+kernel REDUCE_ATTRIBUTES void moments_partial(global const float* Temperatures, int N, global float4* Partials, local float4* localCopy) {
 	int id = get_global_id(0);
 	int lid = get_local_id(0);
-	int N = get_local_size(0);
 
-	localCopy[lid] = Temperatures[id]; //create local copy for quicker accessing 
+	if (id < N) {
+		float t = Temperatures[id];
+		localCopy[lid] = (float4)(t, t*t, t, t);
+	}
+	else {
+		localCopy[lid] = (float4)(0.0f, 0.0f, INFINITY, -INFINITY);
+	}
 
-	barrier(CLK_GLOBAL_MEM_FENCE); //ensure all threads copy
+	barrier(CLK_LOCAL_MEM_FENCE);
 
-	for (int stride=1; stride<N; stride*=2) {
-		if ((lid % (stride*2) == 0)) {
-			localCopy[lid] += localCopy[lid+stride];
+	LOCAL_REDUCE(float4, localCopy, lid, merge_partial4);
+
+	if (!lid) {
+		Partials[get_group_id(0)] = localCopy[0];
+	}
+}
+
+//***Histogram***
+//Temperatures have one decimal place, so counting how often each value in tenths of a degree occurs between the
+//...dataset's min and max (around a thousand bins) gives an exact picture of the distribution. The median, any
+//...percentile and the mode then come from the counts on the host, at the cost of one pass over the data.
+//Each work-group counts into its own copy of the histogram in local memory (local atomics are cheap and only
+//...the group's work-items contend for them), then adds its non-zero bins to the global histogram with one atomic
+//...per bin. Work-items stride over the input, so the launch is a fixed number of groups for any N
+kernel void histogram_tenths(global const float* Values, ulong N, int min_tenths, uint bins, global uint* Histogram, local uint* localHistogram) {
+	size_t lid = get_local_id(0);
+	size_t N_local = get_local_size(0);
+
+	for (size_t b = lid; b < bins; b += N_local) {
+		localHistogram[b] = 0;
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for (size_t i = get_global_id(0); i < N; i += get_global_size(0)) {
+		int bin = convert_int_rte(Values[i] * 10.0f) - min_tenths;
+		atomic_inc(&localHistogram[clamp(bin, 0, (int)bins - 1)]);
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for (size_t b = lid; b < bins; b += N_local) {
+		uint count = localHistogram[b];
+		if (count) {
+			atomic_add(&Histogram[b], count);
 		}
-		barrier(CLK_GLOBAL_MEM_FENCE);
 	}
+}
 
-	if (!lid) {
-		float intpart;
-		float fractpart = modf (localCopy[lid] , &intpart);
-		int convertedInt = convert_int(localCopy[lid]);
-		int convertedDesc = convert_int(fractpart*10); 
-
-		// add the two values to two seperate arrays - one for the integer values and one for the decimal values
-		atomic_add(&Output_reduce[0],convertedInt);
-		atomic_add(&Output_reduce[1],convertedDesc);
-	}
-}
-
-//***Median***
-//Bitonic sort kernels - Only work with small vectors
-void swap_bitonic(global float* A, global float* B, bool dir) {
-	if ((!dir && *A > *B) || (dir && *A < *B)) {
-		//printf("Sort Order: %d\n", dir);
-		float t = *A;
-		*A = *B;
-		*B = t;
-	}
-}
-
-void bitonic_merge(int id, global float* A, int N, bool dir) {
-	for (int i = N/2; i > 0; i/=2) {
-		if ((id % (i*2)) < i) {
-			swap_bitonic(&A[id],&A[id+i],dir);
-		}
-		barrier(CLK_GLOBAL_MEM_FENCE);
-	}
-}
-
-kernel void sort_bitonic(global float* A, global float *Output) {
-	int id = get_global_id(0);
-	int N = get_global_size(0);
-	for (int i = 1; i <= N/2; i*=2) {
-		if (id % (i*4) < i*2) {
-			bitonic_merge(id, A, i*2, false);
-		}
-		else if (((id + i*2) % (i*4)) < i*2) {
-			bitonic_merge(id, A, i*2, true);
-		}
-		barrier(CLK_GLOBAL_MEM_FENCE);
-	}
-	barrier(CLK_GLOBAL_MEM_FENCE);
-	bitonic_merge(id,A,N,false);
-	barrier(CLK_GLOBAL_MEM_FENCE);
-	Output[id] = A[id];
+//Same counts straight into global memory, for ranges too wide for the histogram to fit in local memory
+kernel void histogram_tenths_global(global const float* Values, ulong N, int min_tenths, uint bins, global uint* Histogram) {
+	for (size_t i = get_global_id(0); i < N; i += get_global_size(0)) {
+		int bin = convert_int_rte(Values[i] * 10.0f) - min_tenths;
+		atomic_inc(&Histogram[clamp(bin, 0, (int)bins - 1)]);
+	}
+}
+
+//***Radix select***
+//Exact k-th smallest value of any float data without sorting it. Floats are mapped to uint keys that compare in the
+//...same order (flip every bit of a negative, only the sign bit of a positive), and the key is settled 8 bits at a
+//...time from the top: radix_select_histogram counts the next 8 bits of every value still in the running (its
+//...higher bits equal 'prefix' under 'prefix_mask'), the host picks the bucket that holds k, and radix_select_compact
+//...copies just that bucket's values to a smaller buffer for the next pass. At most four passes, each reading fewer values
+uint float_key(float value) {
+	uint bits = as_uint(value);
+	return bits ^ ((bits >> 31) ? 0xFFFFFFFFu : 0x80000000u);
+}
+
+kernel void radix_select_histogram(global const float* Values, ulong N, uint prefix, uint prefix_mask, uint shift,
+	global uint* Histogram, local uint* localHistogram) {
+	size_t lid = get_local_id(0);
+	size_t N_local = get_local_size(0);
+
+	for (size_t b = lid; b < 256; b += N_local) {
+		localHistogram[b] = 0;
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for (size_t i = get_global_id(0); i < N; i += get_global_size(0)) {
+		uint key = float_key(Values[i]);
+		if ((key & prefix_mask) == prefix) {
+			atomic_inc(&localHistogram[(key >> shift) & 0xFF]);
+		}
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for (size_t b = lid; b < 256; b += N_local) {
+		uint count = localHistogram[b];
+		if (count) {
+			atomic_add(&Histogram[b], count);
+		}
+	}
+}
+
+//Copies the values whose key matches prefix under prefix_mask to Candidates, in no particular order. Each work-group
+//...counts its matches in local memory and reserves room for all of them with one global atomic on Count, so
+//...there is one global atomic per group and step rather than one per value. The loop is the same length for every
+//...work-item of a group so they all reach the barriers
+kernel void radix_select_compact(global const float* Values, ulong N, uint prefix, uint prefix_mask,
+	global float* Candidates, global uint* Count) {
+	local uint groupCount;
+	local uint groupBase;
+	size_t lid = get_local_id(0);
+
+	for (size_t base = get_group_id(0) * get_local_size(0); base < N; base += get_global_size(0)) {
+		size_t i = base + lid;
+		float value = (i < N) ? Values[i] : 0.0f;
+		bool match = (i < N) && ((float_key(value) & prefix_mask) == prefix);
+
+		if (!lid) {
+			groupCount = 0;
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+		uint slot = match ? atomic_inc(&groupCount) : 0;
+		barrier(CLK_LOCAL_MEM_FENCE);
+		if (!lid) {
+			groupBase = atomic_add(Count, groupCount);
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+		if (match) {
+			Candidates[groupBase + slot] = value;
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+}
+
+//***Sort***
+//Bitonic sort of any power of two number of floats (the host pads with +infinity) over several launches. A barrier
+//...only synchronises one work-group, so every stage that compares values further apart than one work-group's block
+//...of 2 * work-group size values is a launch of its own, and everything inside a block runs in local memory:
+//   bitonic_sort_local    sorts every block, alternate blocks in opposite directions
+//   bitonic_merge_global  one compare-exchange stage (distance j) of the merge of size k, one work-item per pair
+//   bitonic_merge_local   the remaining stages of the merge of size k, once j is inside a block
+//Work-item i owns the pair (lo, lo + j), where lo is i with a zero bit inserted at bit j. The pair is put in ascending
+//...order when bit k of lo is clear and descending otherwise, which leaves neighbouring runs of size k in opposite
+//...directions - a bitonic sequence of size 2k for the next merge
+uint bitonic_lo(uint i, uint j) {
+	return ((i & ~(j - 1)) << 1) | (i & (j - 1));
+}
+
+void compare_exchange_local(local float* block, uint a, uint b, bool ascending) {
+	float x = block[a];
+	float y = block[b];
+	if ((x > y) == ascending) {
+		block[a] = y;
+		block[b] = x;
+	}
+}
+
+kernel REDUCE_ATTRIBUTES void bitonic_sort_local(global float* A, local float* block) {
+	uint lid = get_local_id(0);
+	uint N_local = get_local_size(0);
+	uint size = 2 * N_local;
+	uint base = get_group_id(0) * size;
+
+	block[lid] = A[base + lid];
+	block[lid + N_local] = A[base + lid + N_local];
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for (uint k = 2; k <= size; k <<= 1) {
+		for (uint j = k >> 1; j > 0; j >>= 1) {
+			uint lo = bitonic_lo(lid, j);
+			//base is a multiple of size, so at k == size this alternates the direction from block to block
+			compare_exchange_local(block, lo, lo + j, ((base + lo) & k) == 0);
+			barrier(CLK_LOCAL_MEM_FENCE);
+		}
+	}
+
+	A[base + lid] = block[lid];
+	A[base + lid + N_local] = block[lid + N_local];
 }
 
+kernel void bitonic_merge_global(global float* A, uint k, uint j) {
+	uint lo = bitonic_lo(get_global_id(0), j);
+	float x = A[lo];
+	float y = A[lo + j];
+	if ((x > y) == ((lo & k) == 0)) {
+		A[lo] = y;
+		A[lo + j] = x;
+	}
+}
+
+kernel REDUCE_ATTRIBUTES void bitonic_merge_local(global float* A, uint k, local float* block) {
+	uint lid = get_local_id(0);
+	uint N_local = get_local_size(0);
+	uint base = get_group_id(0) * 2 * N_local;
+
+	block[lid] = A[base + lid];
+	block[lid + N_local] = A[base + lid + N_local];
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for (uint j = N_local; j > 0; j >>= 1) {
+		uint lo = bitonic_lo(lid, j);
+		compare_exchange_local(block, lo, lo + j, ((base + lo) & k) == 0);
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+
+	A[base + lid] = block[lid];
+	A[base + lid + N_local] = block[lid + N_local];
+}